@@ -0,0 +1,133 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+
+// Batch mode: a manifest lists workload directories, and every workload is simulated
+// as an independent job on a small work-stealing thread pool.
+//
+// Manifest format, one job per line:
+//   <input dir> [output dir]
+// The output dir defaults to the input dir. Blank lines and lines starting with '#' are skipped.
+
+struct BatchJob
+{
+    string inputDir;
+    string outputDir;
+};
+
+struct BatchResult // one row of the aggregated CSV
+{
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    bool ok = false;
+};
+
+bool readManifest(const string &path, vector<BatchJob> &jobs)
+{
+    ifstream in(path);
+    if (!in.is_open())
+        return false;
+
+    string line;
+    while (getline(in, line))
+    {
+        istringstream fields(line);
+        BatchJob job;
+        if (!(fields >> job.inputDir) || job.inputDir[0] == '#')
+            continue;
+        if (!(fields >> job.outputDir))
+            job.outputDir = job.inputDir;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// Runs run(0) .. run(jobCount - 1) on `threads` workers. Jobs start out dealt
+// round-robin into per-worker deques; a worker takes from the back of its own
+// deque and, once that is empty, steals from the front of the others, so a few
+// long workloads do not leave the rest of the pool idle.
+void runWorkStealing(size_t jobCount, unsigned threads, const function<void(size_t)> &run)
+{
+    threads = max(1u, min<unsigned>(threads, jobCount));
+
+    struct WorkQueue
+    {
+        mutex lock;
+        deque<size_t> jobs;
+    };
+    vector<WorkQueue> queues(threads);
+    for (size_t j = 0; j < jobCount; j++)
+        queues[j % threads].jobs.push_back(j);
+
+    auto worker = [&](unsigned self)
+    {
+        while (true)
+        {
+            size_t job;
+            bool found = false;
+            for (unsigned k = 0; k < threads && !found; k++)
+            {
+                WorkQueue &q = queues[(self + k) % threads];
+                lock_guard<mutex> guard(q.lock);
+                if (q.jobs.empty())
+                    continue;
+                if (k == 0) // own queue, LIFO end
+                {
+                    job = q.jobs.back();
+                    q.jobs.pop_back();
+                }
+                else // steal the oldest job from someone else
+                {
+                    job = q.jobs.front();
+                    q.jobs.pop_front();
+                }
+                found = true;
+            }
+            if (!found) // no job is ever added after the start, so every queue is drained
+                return;
+            run(job);
+        }
+    };
+
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (thread &t : pool)
+        t.join();
+}
+
+bool writeBatchCsv(const string &path, const vector<BatchJob> &jobs, const vector<BatchResult> &results)
+{
+    ofstream csv(path, std::ios_base::trunc);
+    if (!csv.is_open())
+        return false;
+
+    csv << "workload,output,status,cycles,instructions,CPI,IPC\n";
+    for (size_t j = 0; j < jobs.size(); j++)
+    {
+        const BatchResult &r = results[j];
+        csv << jobs[j].inputDir << "," << jobs[j].outputDir << "," << (r.ok ? "ok" : "error") << ","
+            << r.cycles << "," << r.instructions << ",";
+        if (r.ok && r.cycles > 0 && r.instructions > 0)
+            csv << static_cast<float>(r.cycles) / r.instructions << "," << static_cast<float>(r.instructions) / r.cycles;
+        else
+            csv << ",";
+        csv << "\n";
+    }
+    return true;
+}
+
+#endif
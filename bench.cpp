@@ -0,0 +1,460 @@
+// Host-side throughput benchmarks for the simulator: decode, data memory access and
+// both cores running synthetic guest kernels. Built from the simulator's own sources:
+//   g++ -std=c++17 -O2 -pthread -o bench bench.cpp
+// Usage: ./bench [--reps N] [--warmup N] [--filter SUBSTRING] [--csv FILE] [--label NAME]
+//
+// Every benchmark does a fixed amount of guest work, so numbers from different commits
+// (same host, same flags) can be compared directly; --csv appends one row per benchmark
+// tagged with --label for that purpose.
+
+#define SIM_NO_MAIN
+#include "main.cpp"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+// ---------------------------------------------------------------- guest kernels
+
+// Minimal RV32I encoder for the instructions the cores implement
+struct KernelBuilder
+{
+    vector<uint32_t> code;
+
+    uint32_t here() const { return code.size() * 4; }
+
+    void rType(uint8_t funct3, uint8_t funct7, int rd, int rs1, int rs2)
+    {
+        code.push_back(uint32_t(funct7) << 25 | rs2 << 20 | rs1 << 15 | uint32_t(funct3) << 12 | rd << 7 | 0x33);
+    }
+    void iType(uint8_t funct3, int rd, int rs1, int32_t imm)
+    {
+        code.push_back((uint32_t(imm) & 0xFFF) << 20 | rs1 << 15 | uint32_t(funct3) << 12 | rd << 7 | 0x13);
+    }
+    void add(int rd, int rs1, int rs2) { rType(0, 0, rd, rs1, rs2); }
+    void sub(int rd, int rs1, int rs2) { rType(0, 0x20, rd, rs1, rs2); }
+    void xor_(int rd, int rs1, int rs2) { rType(4, 0, rd, rs1, rs2); }
+    void or_(int rd, int rs1, int rs2) { rType(6, 0, rd, rs1, rs2); }
+    void and_(int rd, int rs1, int rs2) { rType(7, 0, rd, rs1, rs2); }
+    void addi(int rd, int rs1, int32_t imm) { iType(0, rd, rs1, imm); }
+    void andi(int rd, int rs1, int32_t imm) { iType(7, rd, rs1, imm); }
+    void lw(int rd, int rs1, int32_t imm)
+    {
+        code.push_back((uint32_t(imm) & 0xFFF) << 20 | rs1 << 15 | 2 << 12 | rd << 7 | 0x03);
+    }
+    void sw(int rs2, int rs1, int32_t imm)
+    {
+        uint32_t i = uint32_t(imm) & 0xFFF;
+        code.push_back((i >> 5) << 25 | rs2 << 20 | rs1 << 15 | 2 << 12 | (i & 0x1F) << 7 | 0x23);
+    }
+    size_t branch(uint8_t funct3, int rs1, int rs2, uint32_t target = 0) // returns the slot, see patch()
+    {
+        code.push_back(0);
+        encodeBranch(code.size() - 1, funct3, rs1, rs2, target);
+        return code.size() - 1;
+    }
+    void patch(size_t slot, uint32_t target) // point a forward branch at target
+    {
+        uint32_t word = code[slot];
+        encodeBranch(slot, (word >> 12) & 7, (word >> 15) & 0x1F, (word >> 20) & 0x1F, target);
+    }
+    void halt() { code.push_back(0xFFFFFFFF); }
+
+    // outer x10 times, inner x11 times around body(), the loop counters are x10/x11
+    void loop(int outer, int inner, const function<void()> &body)
+    {
+        addi(10, 0, outer);
+        uint32_t outerTop = here();
+        addi(11, 0, inner);
+        uint32_t innerTop = here();
+        body();
+        addi(11, 11, -1);
+        branch(1, 11, 0, innerTop); // bne
+        addi(10, 10, -1);
+        branch(1, 10, 0, outerTop);
+        halt();
+    }
+
+private:
+    void encodeBranch(size_t slot, uint8_t funct3, int rs1, int rs2, uint32_t target)
+    {
+        uint32_t o = (target - slot * 4) & 0x1FFF;
+        code[slot] = ((o >> 12) & 1) << 31 | ((o >> 5) & 0x3F) << 25 | rs2 << 20 | rs1 << 15 | uint32_t(funct3) << 12 |
+                     ((o >> 1) & 0xF) << 8 | ((o >> 11) & 1) << 7 | 0x63;
+    }
+};
+
+struct Kernel
+{
+    string name;
+    vector<uint32_t> code;
+};
+
+vector<Kernel> makeKernels(int outer) // inner loops run 1000 times, so outer scales the work
+{
+    vector<Kernel> kernels;
+    KernelBuilder k;
+
+    k = KernelBuilder(); // independent ALU work
+    k.loop(outer, 1000, [&]
+           { k.add(2, 2, 11); k.xor_(3, 3, 11); k.or_(4, 4, 11); k.and_(5, 5, 11); k.sub(6, 6, 11); k.addi(7, 7, 1); });
+    kernels.push_back({"alu", k.code});
+
+    k = KernelBuilder(); // store then load a walk over 1 KiB
+    k.loop(outer, 1000, [&]
+           { k.andi(2, 11, 0xFF); k.add(2, 2, 2); k.add(2, 2, 2);
+             k.sw(11, 2, 256); k.lw(3, 2, 256); k.add(4, 4, 3); });
+    kernels.push_back({"loadstore", k.code});
+
+    k = KernelBuilder(); // two data-dependent branches per iteration, period 2 and 4
+    k.loop(outer, 1000, [&]
+           {
+               k.andi(2, 11, 1);
+               size_t skip1 = k.branch(0, 2, 0); // beq
+               k.addi(3, 3, 1);
+               k.patch(skip1, k.here());
+               k.andi(4, 11, 2);
+               size_t skip2 = k.branch(1, 4, 0); // bne
+               k.addi(5, 5, 1);
+               k.patch(skip2, k.here()); });
+    kernels.push_back({"branchy", k.code});
+
+    k = KernelBuilder(); // every instruction needs the previous result
+    k.loop(outer, 1000, [&]
+           { k.add(2, 2, 11); k.add(2, 2, 2); k.xor_(2, 2, 11); k.add(2, 2, 2); k.sub(2, 2, 11); });
+    kernels.push_back({"depchain", k.code});
+
+    return kernels;
+}
+
+string writeKernel(const Kernel &kernel) // imem.bin/dmem.bin in a scratch dir, returns the dir
+{
+    filesystem::path dir = filesystem::temp_directory_path() / ("rvsim_bench_" + kernel.name);
+    filesystem::create_directories(dir);
+
+    ofstream imem(dir / "imem.bin", ios::binary | ios::trunc);
+    for (uint32_t word : kernel.code) // most significant byte first, like imem.txt
+    {
+        char b[4] = {char(word >> 24), char(word >> 16), char(word >> 8), char(word)};
+        imem.write(b, 4);
+    }
+    ofstream dmem(dir / "dmem.bin", ios::binary | ios::trunc);
+    vector<char> zeros(4096, 0);
+    dmem.write(zeros.data(), zeros.size());
+    return dir.string();
+}
+
+// ---------------------------------------------------------------- harness
+
+struct Sample // one timed repetition
+{
+    uint64_t instructions = 0; // guest instructions (or decodes / memory accesses)
+    uint64_t cycles = 0;       // simulated cycles, 0 where that means nothing
+    double seconds = 0;
+};
+
+struct Benchmark
+{
+    string name;
+    function<Sample()> run; // sets up untimed, times only the hot loop
+};
+
+template <typename F>
+double timeIt(F body)
+{
+    auto start = chrono::steady_clock::now();
+    body();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+struct Stats
+{
+    double mean = 0, stddev = 0, min = 0, max = 0;
+};
+
+Stats summarize(const vector<double> &values)
+{
+    Stats s;
+    if (values.empty())
+        return s;
+    s.min = *min_element(values.begin(), values.end());
+    s.max = *max_element(values.begin(), values.end());
+    for (double v : values)
+        s.mean += v;
+    s.mean /= values.size();
+    for (double v : values)
+        s.stddev += (v - s.mean) * (v - s.mean);
+    s.stddev = values.size() > 1 ? sqrt(s.stddev / (values.size() - 1)) : 0;
+    return s;
+}
+
+volatile uint64_t benchSink; // keeps results of pure loops alive
+
+string readFile(const string &path)
+{
+    ifstream in(path);
+    stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+uint64_t metricValue(const string &metrics, const string &label) // "<label><number>" line of a metrics text file
+{
+    size_t at = metrics.find(label);
+    return at == string::npos ? 0 : stoull(metrics.substr(at + label.size()));
+}
+
+struct QuietCout // whatever still reaches cout (load errors etc.) is thrown away while measuring
+{
+    streambuf *saved = cout.rdbuf(nullptr);
+    ~QuietCout()
+    {
+        cout.rdbuf(saved);
+        cout.clear();
+    }
+};
+
+vector<Benchmark> makeBenchmarks()
+{
+    vector<Benchmark> benches;
+    vector<Kernel> kernels = makeKernels(200);
+
+    vector<uint32_t> words; // every kernel's instructions, decoded round-robin
+    for (const Kernel &k : kernels)
+        words.insert(words.end(), k.code.begin(), k.code.end());
+
+    benches.push_back({"decode.checkInstr", [words]
+                       {
+                           Sample s;
+                           uint64_t sum = 0;
+                           const uint64_t n = 2000000;
+                           s.seconds = timeIt([&]
+                                              {
+                                                  for (uint64_t i = 0; i < n; i++)
+                                                      sum += checkInstr(bitset<32>(words[i % words.size()])).rd.to_ulong(); });
+                           benchSink = sum;
+                           s.instructions = n;
+                           return s;
+                       }});
+
+    benches.push_back({"decode.predecode", [words]
+                       {
+                           Sample s;
+                           uint64_t sum = 0;
+                           const uint64_t n = 20000000;
+                           s.seconds = timeIt([&]
+                                              {
+                                                  for (uint64_t i = 0; i < n; i++)
+                                                      sum += predecode(words[i % words.size()]).op; });
+                           benchSink = sum;
+                           s.instructions = n;
+                           return s;
+                       }});
+
+    string memDir = writeKernel(kernels[1]);
+    benches.push_back({"memory.readWrite", [memDir]
+                       {
+                           Sample s;
+                           DataMem dmem("BENCH", memDir);
+                           uint64_t sum = 0;
+                           const uint32_t n = 10000000;
+                           s.seconds = timeIt([&]
+                                              {
+                                                  for (uint32_t i = 0; i < n; i++)
+                                                  {
+                                                      uint32_t address = (i * 4) & 0xFFFF; // 64 KiB window, 16 pages
+                                                      dmem.writeDataMem(address, i);
+                                                      sum += dmem.readDataMem(address ^ 0x100);
+                                                  } });
+                           benchSink = sum;
+                           s.instructions = 2ull * n; // accesses
+                           return s;
+                       }});
+
+    for (const Kernel &kernel : kernels)
+    {
+        string dir = writeKernel(kernel);
+
+        benches.push_back({"ss.step." + kernel.name, [dir]
+                           {
+                               Sample s;
+                               InsMem imem("Imem", dir);
+                               DataMem dmem("BENCH", dir);
+                               SingleStageCore core(dir, imem, dmem, TRACE_OFF);
+                               s.seconds = timeIt([&]
+                                                  {
+                                                      while (!core.halted)
+                                                          core.step(); });
+                               s.instructions = core.instructionCount();
+                               s.cycles = core.cycle;
+                               return s;
+                           }});
+
+        benches.push_back({"ss.run." + kernel.name, [dir]
+                           {
+                               Sample s;
+                               InsMem imem("Imem", dir);
+                               DataMem dmem("BENCH", dir);
+                               SingleStageCore core(dir, imem, dmem, TRACE_OFF);
+                               s.seconds = timeIt([&]
+                                                  {
+                                                      while (!core.halted)
+                                                          core.run(UINT64_MAX); });
+                               s.instructions = core.instructionCount();
+                               s.cycles = core.cycle;
+                               return s;
+                           }});
+
+        benches.push_back({"fs.step." + kernel.name, [dir]
+                           {
+                               Sample s;
+                               InsMem imem("Imem", dir);
+                               DataMem dmem("BENCH", dir);
+                               FiveStageCore core(dir, imem, dmem, TRACE_OFF);
+                               s.seconds = timeIt([&]
+                                                  {
+                                                      while (!core.halted)
+                                                          core.step(); });
+                               s.instructions = core.instructionCount();
+                               s.cycles = core.cycle;
+                               return s;
+                           }});
+
+        benches.push_back({"fs.run." + kernel.name, [dir]
+                           {
+                               Sample s;
+                               InsMem imem("Imem", dir);
+                               DataMem dmem("BENCH", dir);
+                               FiveStageCore core(dir, imem, dmem, TRACE_OFF);
+                               s.seconds = timeIt([&]
+                                                  { core.run(); });
+                               s.instructions = core.instructionCount();
+                               s.cycles = core.cycle;
+                               return s;
+                           }});
+    }
+
+    // four cores on the store/load walk, all of them on the same lines. Besides the speed this
+    // checks that the bus ordering makes repetitions agree: any difference in the per-core or
+    // bus metrics ends the run.
+    Kernel shared = makeKernels(20)[1]; // a tenth of the work, the cores take turns on every access
+    shared.name = "mc_loadstore";
+    string mcDir = writeKernel(shared);
+    benches.push_back({"mc.run.loadstore", [mcDir]
+                       {
+                           const int cores = 4;
+                           CacheSetup setup;
+                           parseCacheConfig("256,2,16,lru,wb,1", setup.l1d);
+                           Sample s;
+                           s.seconds = timeIt([&]
+                                              { runMultiCore(mcDir, cores, TRACE_OFF, "static", setup, PROTOCOL_MESI, 4, 10,
+                                                             false, true, true, MulDivSetup()); });
+
+                           string metrics = readFile(joinPath(mcDir, "PerformanceMetrics_Bus.txt"));
+                           for (int i = 0; i < cores; i++)
+                               metrics += readFile(joinPath(mcDir, "PerformanceMetrics_FS" + to_string(i) + ".txt"));
+                           static string first = metrics;
+                           if (metrics != first)
+                           {
+                               cerr << "mc.run.loadstore: metrics differ between repetitions" << endl;
+                               exit(1);
+                           }
+                           s.instructions = metricValue(metrics, "#Instructions (all cores) -> ");
+                           s.cycles = metricValue(metrics, "#Cycles (slowest core) -> ");
+                           return s;
+                       }});
+    return benches;
+}
+
+int main(int argc, char *argv[])
+{
+    int reps = 5;
+    int warmup = 1;
+    string filter = "";
+    string csvPath = "";
+    string label = "";
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--reps" && i + 1 < argc)
+            reps = max(1, stoi(argv[++i]));
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = max(0, stoi(argv[++i]));
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (arg == "--csv" && i + 1 < argc)
+            csvPath = argv[++i];
+        else if (arg == "--label" && i + 1 < argc)
+            label = argv[++i];
+        else
+        {
+            cout << "Usage: ./bench [--reps N] [--warmup N] [--filter SUBSTRING] [--csv FILE] [--label NAME]" << endl;
+            return -1;
+        }
+    }
+
+    ostream discard(nullptr); // the cores' per-cycle console messages are not part of the measurement
+    simConsole = &discard;
+
+    ofstream csv;
+    if (!csvPath.empty())
+    {
+        bool fresh = !filesystem::exists(csvPath);
+        csv.open(csvPath, ios::app);
+        if (!csv.is_open())
+        {
+            cout << "Unable to open " << csvPath << " for writing." << endl;
+            return -1;
+        }
+        if (fresh)
+            csv << "label,benchmark,reps,instructions,cycles,mips_mean,mips_stddev,mips_min,mips_max,mcps_mean\n";
+    }
+
+    cout << left << setw(26) << "benchmark" << right << setw(12) << "work" << setw(11) << "MIPS" << setw(9) << "+-%"
+         << setw(11) << "min" << setw(11) << "max" << setw(13) << "Mcycles/s" << endl;
+
+    for (Benchmark &bench : makeBenchmarks())
+    {
+        if (bench.name.find(filter) == string::npos)
+            continue;
+
+        for (int w = 0; w < warmup; w++)
+        {
+            QuietCout quiet;
+            bench.run();
+        }
+
+        vector<double> mips, mcps;
+        Sample last;
+        for (int r = 0; r < reps; r++)
+        {
+            {
+                QuietCout quiet;
+                last = bench.run();
+            }
+            mips.push_back(last.instructions / last.seconds / 1e6);
+            mcps.push_back(last.cycles / last.seconds / 1e6);
+        }
+        Stats m = summarize(mips);
+        Stats c = summarize(mcps);
+
+        cout << left << setw(26) << bench.name << right << setw(12) << last.instructions << fixed << setprecision(2)
+             << setw(11) << m.mean << setw(9) << (m.mean > 0 ? 100 * m.stddev / m.mean : 0) << setw(11) << m.min
+             << setw(11) << m.max << setw(13);
+        if (last.cycles)
+            cout << c.mean;
+        else
+            cout << "-";
+        cout << defaultfloat << endl;
+
+        if (csv.is_open())
+            csv << label << "," << bench.name << "," << reps << "," << last.instructions << "," << last.cycles << ","
+                << m.mean << "," << m.stddev << "," << m.min << "," << m.max << "," << c.mean << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "type_SE.h"
+#include "sparse_memory.h"
+
+using namespace std;
+
+// Basic blocks for the single-stage fast path. A block is a straight run of predecoded
+// instructions that ends at a branch, JAL or JALR, in front of a halt or a trapping
+// instruction, or after BLOCK_MAX_INSTRUCTIONS. Instruction memory is never written while
+// a core runs, so a block stays valid once translated and its successors can be linked to
+// it directly (except a JALR's, whose target comes from a register).
+
+#ifndef BLOCK_MAX_INSTRUCTIONS
+#define BLOCK_MAX_INSTRUCTIONS 64
+#endif
+
+#define BLOCK_FALLTHROUGH OP_COUNT // op of the closing entry of a block that does not end in a branch or jump
+
+struct BlockOp // one instruction with everything its handler needs, 8 bytes
+{
+    uint8_t op;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    int32_t imm;
+};
+
+struct TranslatedBlock
+{
+    uint32_t startPC = 0;
+    uint32_t endPC = 0;  // PC of the last instruction (the branch or jump, if there is one)
+    uint32_t count = 0;  // instructions executed by one pass, 0 for a block that starts at a halt or trap
+    vector<BlockOp> ops; // count entries, plus a BLOCK_FALLTHROUGH entry if the block has no branch or jump
+    TranslatedBlock *next[2] = {nullptr, nullptr}; // chained successors: [0] fall-through or not taken, [1] taken
+};
+
+class BlockCache
+{
+public:
+    // Block starting at PC, translated from decodeAt(PC) on first use
+    template <typename Decode>
+    TranslatedBlock *lookup(uint32_t PC, Decode decodeAt)
+    {
+        TranslatedBlock *&slot = (*index.get(PC >> SIM_PAGE_BITS, true))[(PC & SIM_PAGE_MASK) >> 2];
+        if (!slot)
+        {
+            blocks.emplace_back(new TranslatedBlock());
+            slot = blocks.back().get();
+            translate(*slot, PC, decodeAt);
+        }
+        return slot;
+    }
+
+private:
+    template <typename Decode>
+    void translate(TranslatedBlock &block, uint32_t PC, Decode decodeAt)
+    {
+        block.startPC = PC;
+        block.endPC = PC;
+        while (block.count < BLOCK_MAX_INSTRUCTIONS)
+        {
+            const MicroOp &uop = decodeAt(PC);
+            if (uop.opClass == OPC_HALT || uop.opClass == OPC_SYSTEM || uop.opClass == OPC_ILLEGAL) // left to the per-instruction engine
+                break;
+
+            if (uop.op == OP_AUIPC) // the block's PCs are fixed, so this is a constant
+                block.ops.push_back({OP_LUI, uop.rd, 0, 0, static_cast<int32_t>(PC + uop.imm)});
+            else
+                block.ops.push_back({uop.op, uop.rd, uop.rs1, uop.rs2, uop.imm});
+            block.endPC = PC;
+            block.count++;
+            if (uop.opClass == OPC_BRANCH || uop.opClass == OPC_JAL || uop.opClass == OPC_JALR)
+                return;
+            PC += 4;
+        }
+        block.ops.push_back({BLOCK_FALLTHROUGH, 0, 0, 0, 0});
+    }
+
+    PageMap<array<TranslatedBlock *, SIM_PAGE_SIZE / 4>> index; // block starting at each instruction address
+    vector<unique_ptr<TranslatedBlock>> blocks;
+};
+
+#endif
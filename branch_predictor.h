@@ -0,0 +1,222 @@
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "checkpoint.h"
+
+using namespace std;
+
+// Front-end prediction for the five-stage core. IF asks the BTB whether the fetch PC is a
+// known branch or jump; jumps go to their target, branches only if the direction predictor
+// says taken. EX resolves every branch and jump and updates both structures.
+
+#ifndef BP_TABLE_BITS
+#define BP_TABLE_BITS 10 // 2^BP_TABLE_BITS two-bit counters for bimodal and gshare
+#endif
+#ifndef BTB_ENTRIES
+#define BTB_ENTRIES 256 // direct mapped, power of two
+#endif
+
+class BranchPredictor // direction only, targets come from the BTB
+{
+public:
+    virtual ~BranchPredictor() {}
+    virtual const char *name() const = 0;
+    virtual bool predict(uint32_t PC) = 0;             // true = taken
+    virtual void update(uint32_t PC, bool taken) = 0;  // called once the branch resolves
+    virtual void save(ostream &out) const {}           // table contents for checkpoints
+    virtual void load(istream &in) {}
+};
+
+// The concrete predictors are final, so a core that knows the type at compile time (see
+// FiveStageConfig) calls predict/update directly instead of through the vtable.
+
+class StaticNotTakenPredictor final : public BranchPredictor
+{
+public:
+    const char *name() const { return "static"; }
+    bool predict(uint32_t PC) { return false; }
+    void update(uint32_t PC, bool taken) {}
+};
+
+class TwoBitCounters // table of two-bit saturating counters, shared by bimodal and gshare
+{
+public:
+    TwoBitCounters() : counters(1u << BP_TABLE_BITS, 1) {} // start weakly not taken
+
+    uint32_t mask() const { return counters.size() - 1; }
+
+    bool taken(uint32_t index) const
+    {
+        return counters[index] >= 2;
+    }
+
+    void train(uint32_t index, bool taken)
+    {
+        uint8_t &c = counters[index];
+        if (taken && c < 3)
+            c++;
+        else if (!taken && c > 0)
+            c--;
+    }
+
+    void save(ostream &out) const
+    {
+        out.write(reinterpret_cast<const char *>(counters.data()), counters.size());
+    }
+
+    void load(istream &in)
+    {
+        in.read(reinterpret_cast<char *>(counters.data()), counters.size());
+    }
+
+private:
+    vector<uint8_t> counters;
+};
+
+class BimodalPredictor final : public BranchPredictor // per-PC two-bit saturating counters
+{
+public:
+    const char *name() const { return "bimodal"; }
+
+    bool predict(uint32_t PC)
+    {
+        return table.taken(index(PC));
+    }
+
+    void update(uint32_t PC, bool taken)
+    {
+        table.train(index(PC), taken);
+    }
+
+    void save(ostream &out) const
+    {
+        table.save(out);
+    }
+
+    void load(istream &in)
+    {
+        table.load(in);
+    }
+
+private:
+    uint32_t index(uint32_t PC) const
+    {
+        return (PC >> 2) & table.mask();
+    }
+
+    TwoBitCounters table;
+};
+
+class GsharePredictor final : public BranchPredictor // counters indexed by PC xor global history
+{
+public:
+    const char *name() const { return "gshare"; }
+
+    bool predict(uint32_t PC)
+    {
+        return table.taken(index(PC));
+    }
+
+    void update(uint32_t PC, bool taken)
+    {
+        table.train(index(PC), taken);
+        history = ((history << 1) | (taken ? 1 : 0)) & table.mask();
+    }
+
+    void save(ostream &out) const
+    {
+        table.save(out);
+        putU32(out, history);
+    }
+
+    void load(istream &in)
+    {
+        table.load(in);
+        history = getU32(in) & table.mask();
+    }
+
+private:
+    uint32_t index(uint32_t PC) const
+    {
+        return ((PC >> 2) ^ history) & table.mask();
+    }
+
+    TwoBitCounters table;
+    uint32_t history = 0; // outcomes of the most recent branches, newest in bit 0
+};
+
+// "static", "bimodal" or "gshare"; nullptr for anything else
+unique_ptr<BranchPredictor> makeBranchPredictor(const string &name)
+{
+    if (name == "static")
+        return unique_ptr<BranchPredictor>(new StaticNotTakenPredictor());
+    if (name == "bimodal")
+        return unique_ptr<BranchPredictor>(new BimodalPredictor());
+    if (name == "gshare")
+        return unique_ptr<BranchPredictor>(new GsharePredictor());
+    return nullptr;
+}
+
+class BranchTargetBuffer
+{
+public:
+    BranchTargetBuffer() : entries(BTB_ENTRIES) {}
+
+    bool lookup(uint32_t PC, uint32_t &target, bool &conditional) const // false on a miss
+    {
+        const Entry &e = entries[(PC >> 2) & (BTB_ENTRIES - 1)];
+        if (!e.valid || e.PC != PC)
+            return false;
+        target = e.target;
+        conditional = e.conditional;
+        return true;
+    }
+
+    void update(uint32_t PC, uint32_t target, bool conditional)
+    {
+        Entry &e = entries[(PC >> 2) & (BTB_ENTRIES - 1)];
+        e.PC = PC;
+        e.target = target;
+        e.conditional = conditional;
+        e.valid = true;
+    }
+
+    void save(ostream &out) const
+    {
+        for (const Entry &e : entries)
+        {
+            putU32(out, e.PC);
+            putU32(out, e.target);
+            putU8(out, (e.valid ? 1 : 0) | (e.conditional ? 2 : 0));
+        }
+    }
+
+    void load(istream &in)
+    {
+        for (Entry &e : entries)
+        {
+            e.PC = getU32(in);
+            e.target = getU32(in);
+            uint8_t flags = getU8(in);
+            e.valid = flags & 1;
+            e.conditional = flags & 2;
+        }
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t PC = 0; // full address as the tag
+        uint32_t target = 0;
+        bool conditional = false; // branch (ask the predictor) or jump (always taken)
+        bool valid = false;
+    };
+    vector<Entry> entries;
+};
+
+#endif
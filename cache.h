@@ -0,0 +1,478 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "checkpoint.h"
+
+using namespace std;
+
+// Timing model of a set-associative cache. Data always lives in InsMem/DataMem; a cache
+// only tracks tags so it can say how many cycles an access takes. Tags, flags and
+// replacement state are separate flat arrays (set-major, one entry per way), so a lookup
+// scans a few adjacent words.
+//
+// Latencies are totals: an L1 hit with hitLatency 1 costs no stall, a miss costs this
+// level's hitLatency plus whatever the next level (another cache or memory) takes.
+// Write-backs of dirty lines and write-through traffic go through a write buffer and
+// never add latency, but they are counted at the next level.
+//
+// A write-back L1D can be attached to a snooping bus (coherence.h) shared with the L1Ds of
+// other cores. Its lines then follow MSI/MESI: a valid line is Shared, Exclusive (only copy,
+// clean) or Modified (only copy, dirty). Misses and writes to Shared lines become bus
+// requests, and the other caches snoop them.
+
+enum ReplacementPolicy : uint8_t
+{
+    REPL_LRU,
+    REPL_PLRU, // tree pseudo-LRU, needs a power-of-two number of ways
+    REPL_RANDOM
+};
+
+enum WritePolicy : uint8_t
+{
+    WRITE_BACK,   // write-allocate, dirty lines written back on eviction
+    WRITE_THROUGH // no-write-allocate, every write is passed to the next level
+};
+
+struct CacheConfig
+{
+    uint32_t size = 0; // bytes, 0 = no cache
+    uint32_t ways = 1;
+    uint32_t lineSize = 32;
+    ReplacementPolicy replacement = REPL_LRU;
+    WritePolicy writePolicy = WRITE_BACK;
+    uint32_t hitLatency = 1;
+};
+
+enum BusRequest : uint8_t
+{
+    BUS_READ,           // read miss, other copies may stay
+    BUS_READ_EXCLUSIVE, // write miss, other copies are invalidated
+    BUS_UPGRADE         // write to a Shared line, other copies are invalidated, no data moves
+};
+
+struct BusReply
+{
+    uint32_t latency = 0;   // arbitration wait plus the transfer, in cycles
+    bool exclusive = false; // no other cache keeps a copy, the line may become E or M
+    bool fromCache = false; // a Modified copy elsewhere supplied the data, the next level is not asked
+};
+
+class Cache;
+
+class CoherenceAgent // the snooping bus as the caches attached to it see it, implemented in coherence.h
+{
+public:
+    mutex lock; // held for every access to an attached cache, a snoop changes the lines of other cores
+
+    virtual ~CoherenceAgent() {}
+    virtual BusReply request(int port, BusRequest kind, uint32_t address, uint64_t cycle) = 0;
+
+    int connect(Cache *cache) // port number of a newly attached cache
+    {
+        caches.push_back(cache);
+        return caches.size() - 1;
+    }
+
+protected:
+    vector<Cache *> caches; // indexed by port
+};
+
+bool isPowerOfTwo(uint32_t v)
+{
+    return v != 0 && (v & (v - 1)) == 0;
+}
+
+// "SIZE,WAYS,LINE[,lru|plru|random][,wb|wt][,HITLATENCY]", e.g. "8192,4,32,plru,wb,1"
+bool parseCacheConfig(const string &spec, CacheConfig &config)
+{
+    vector<string> parts;
+    stringstream in(spec);
+    string part;
+    while (getline(in, part, ','))
+        parts.push_back(part);
+    if (parts.size() < 3)
+        return false;
+
+    try
+    {
+        config.size = stoul(parts[0]);
+        config.ways = stoul(parts[1]);
+        config.lineSize = stoul(parts[2]);
+        for (size_t i = 3; i < parts.size(); i++)
+        {
+            if (parts[i] == "lru")
+                config.replacement = REPL_LRU;
+            else if (parts[i] == "plru")
+                config.replacement = REPL_PLRU;
+            else if (parts[i] == "random")
+                config.replacement = REPL_RANDOM;
+            else if (parts[i] == "wb")
+                config.writePolicy = WRITE_BACK;
+            else if (parts[i] == "wt")
+                config.writePolicy = WRITE_THROUGH;
+            else
+                config.hitLatency = stoul(parts[i]);
+        }
+    }
+    catch (const exception &)
+    {
+        return false;
+    }
+
+    if (!isPowerOfTwo(config.lineSize) || !isPowerOfTwo(config.ways) || config.ways > 64 ||
+        config.size % (config.ways * config.lineSize) != 0 || !isPowerOfTwo(config.size / (config.ways * config.lineSize)))
+        return false;
+    return config.hitLatency >= 1;
+}
+
+class Cache
+{
+public:
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t writebacks = 0; // dirty lines sent to the next level
+    uint64_t upgrades = 0;      // writes to Shared lines that had to invalidate other copies
+    uint64_t invalidations = 0; // lines lost to other caches' writes
+    uint64_t interventions = 0; // Modified lines supplied to another cache's request
+
+    // next is the next level (nullptr = main memory, which answers in memoryLatency cycles)
+    Cache(const string &name, const CacheConfig &config, Cache *next, uint32_t memoryLatency)
+        : name{name}, config{config}, next{next}, memoryLatency{memoryLatency}
+    {
+        sets = config.size / (config.ways * config.lineSize);
+        while ((1u << lineBits) < config.lineSize)
+            lineBits++;
+        while ((1u << setBits) < sets)
+            setBits++;
+        while ((1u << treeLevels) < config.ways)
+            treeLevels++;
+
+        tags.assign(sets * config.ways, 0);
+        flags.assign(sets * config.ways, 0);
+        lastUse.assign(sets * config.ways, 0);
+        plru.assign(sets, 0);
+    }
+
+    const string &cacheName() const { return name; }
+    uint32_t lines() const { return tags.size(); }
+    bool coherent() const { return bus != nullptr; }
+
+    void attach(CoherenceAgent &agent) // write-back caches only
+    {
+        bus = &agent;
+        port = agent.connect(this);
+    }
+
+    // Returns the latency of this access in cycles. `cycle` is the requesting core's clock,
+    // the bus needs it to arbitrate between cores.
+    uint32_t access(uint32_t address, bool write, uint64_t cycle = 0)
+    {
+        uint32_t line = address >> lineBits;
+        uint32_t set = line & (sets - 1);
+        uint32_t tag = line >> setBits;
+        uint32_t base = set * config.ways;
+
+        for (uint32_t w = 0; w < config.ways; w++)
+        {
+            if ((flags[base + w] & LINE_VALID) && tags[base + w] == tag)
+            {
+                hits++;
+                touch(set, w);
+                uint32_t latency = config.hitLatency;
+                if (write)
+                {
+                    if (bus && !(flags[base + w] & LINE_EXCLUSIVE)) // Shared: the other copies go first
+                    {
+                        upgrades++;
+                        latency += bus->request(port, BUS_UPGRADE, address, cycle).latency;
+                        flags[base + w] |= LINE_EXCLUSIVE;
+                    }
+                    if (config.writePolicy == WRITE_BACK)
+                        flags[base + w] |= LINE_DIRTY;
+                    else
+                        lower(address, true);
+                }
+                return latency;
+            }
+        }
+
+        misses++;
+        if (write && config.writePolicy == WRITE_THROUGH) // no allocation, the write buffer takes it
+        {
+            lower(address, true);
+            return config.hitLatency;
+        }
+
+        uint32_t latency = config.hitLatency;
+        bool exclusive = true;
+        if (bus)
+        {
+            BusReply reply = bus->request(port, write ? BUS_READ_EXCLUSIVE : BUS_READ, address, cycle);
+            latency += reply.latency + (reply.fromCache ? 0 : lower(address, false));
+            exclusive = reply.exclusive;
+        }
+        else
+            latency += lower(address, false); // line fill
+        uint32_t w = victim(set);
+        if (flags[base + w] & LINE_VALID)
+        {
+            evictions++;
+            if (flags[base + w] & LINE_DIRTY)
+            {
+                writebacks++;
+                lower(((tags[base + w] << setBits) | set) << lineBits, true);
+            }
+        }
+        tags[base + w] = tag;
+        flags[base + w] = LINE_VALID | (write ? LINE_DIRTY : 0) | (exclusive ? LINE_EXCLUSIVE : 0);
+        touch(set, w);
+        return latency;
+    }
+
+    // Another cache's bus request for the line holding `address`. Returns whether this cache
+    // had a copy; `dirty` is set if that copy was Modified and is handed over. A read leaves
+    // the copy Shared, the exclusive requests invalidate it.
+    bool snoop(uint32_t address, bool invalidate, bool &dirty)
+    {
+        uint32_t line = address >> lineBits;
+        uint32_t set = line & (sets - 1);
+        uint32_t tag = line >> setBits;
+        uint32_t base = set * config.ways;
+
+        dirty = false;
+        for (uint32_t w = 0; w < config.ways; w++)
+        {
+            uint8_t &f = flags[base + w];
+            if (!(f & LINE_VALID) || tags[base + w] != tag)
+                continue;
+            if (f & LINE_DIRTY)
+            {
+                dirty = true;
+                interventions++;
+            }
+            if (invalidate)
+            {
+                invalidations++;
+                f = 0;
+            }
+            else
+                f = LINE_VALID; // the memory copy is up to date again after the intervention
+            return true;
+        }
+        return false;
+    }
+
+    void save(ostream &out) const
+    {
+        for (size_t i = 0; i < tags.size(); i++)
+        {
+            putU32(out, tags[i]);
+            putU8(out, flags[i]);
+            putU32(out, lastUse[i]);
+        }
+        for (uint64_t bits : plru)
+            putU64(out, bits);
+        for (uint64_t c : {hits, misses, evictions, writebacks, uint64_t(useClock), uint64_t(rng)})
+            putU64(out, c);
+    }
+
+    void load(istream &in)
+    {
+        for (size_t i = 0; i < tags.size(); i++)
+        {
+            tags[i] = getU32(in);
+            flags[i] = getU8(in);
+            lastUse[i] = getU32(in);
+        }
+        for (uint64_t &bits : plru)
+            bits = getU64(in);
+        hits = getU64(in);
+        misses = getU64(in);
+        evictions = getU64(in);
+        writebacks = getU64(in);
+        useClock = getU64(in);
+        rng = getU64(in);
+    }
+
+private:
+    static const uint8_t LINE_VALID = 1;
+    static const uint8_t LINE_DIRTY = 2;
+    static const uint8_t LINE_EXCLUSIVE = 4; // coherent caches: no other cache has the line (E, or M with DIRTY)
+
+    uint32_t lower(uint32_t address, bool write)
+    {
+        if (next)
+            return next->access(address, write);
+        return write ? 0 : memoryLatency;
+    }
+
+    void touch(uint32_t set, uint32_t way)
+    {
+        lastUse[set * config.ways + way] = ++useClock;
+
+        // point every tree node on the way's path at the other half
+        uint64_t &tree = plru[set];
+        uint32_t node = 0;
+        for (uint32_t level = 0; level < treeLevels; level++)
+        {
+            uint32_t bit = (way >> (treeLevels - 1 - level)) & 1;
+            if (bit)
+                tree &= ~(uint64_t(1) << node);
+            else
+                tree |= uint64_t(1) << node;
+            node = 2 * node + 1 + bit;
+        }
+    }
+
+    uint32_t victim(uint32_t set)
+    {
+        uint32_t base = set * config.ways;
+        for (uint32_t w = 0; w < config.ways; w++)
+            if (!(flags[base + w] & LINE_VALID))
+                return w;
+
+        switch (config.replacement)
+        {
+        case REPL_PLRU:
+        {
+            uint32_t node = 0, way = 0;
+            for (uint32_t level = 0; level < treeLevels; level++)
+            {
+                uint32_t bit = (plru[set] >> node) & 1;
+                way = (way << 1) | bit;
+                node = 2 * node + 1 + bit;
+            }
+            return way;
+        }
+        case REPL_RANDOM:
+            rng ^= rng << 13; // xorshift32, fixed seed so runs are repeatable
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            return rng & (config.ways - 1);
+        default:
+        {
+            uint32_t oldest = 0;
+            for (uint32_t w = 1; w < config.ways; w++)
+                if (lastUse[base + w] < lastUse[base + oldest])
+                    oldest = w;
+            return oldest;
+        }
+        }
+    }
+
+    string name;
+    CacheConfig config;
+    Cache *next;
+    uint32_t memoryLatency;
+    uint32_t sets = 1;
+    uint32_t lineBits = 0;
+    uint32_t setBits = 0;
+    uint32_t treeLevels = 0;
+    uint32_t useClock = 0;
+    uint32_t rng = 0x2545F491;
+    CoherenceAgent *bus = nullptr; // coherent L1D only
+    int port = -1;
+
+    vector<uint32_t> tags;    // [set * ways + way]
+    vector<uint8_t> flags;    // LINE_VALID | LINE_DIRTY | LINE_EXCLUSIVE
+    vector<uint32_t> lastUse; // LRU timestamps
+    vector<uint64_t> plru;    // one tree per set, ways - 1 node bits
+};
+
+struct CacheSetup // what the command line asked for
+{
+    CacheConfig l1i, l1d, l2; // size 0 = level not present
+    uint32_t memoryLatency = 50;
+};
+
+// L1I and L1D, optionally backed by a shared L2. Without an L1 an access costs a single cycle,
+// like the original zero-latency memories.
+class CacheHierarchy
+{
+public:
+    void configure(const CacheSetup &setup)
+    {
+        l2.reset(setup.l2.size ? new Cache("L2", setup.l2, nullptr, setup.memoryLatency) : nullptr);
+        l1i.reset(setup.l1i.size ? new Cache("L1I", setup.l1i, l2.get(), setup.memoryLatency) : nullptr);
+        l1d.reset(setup.l1d.size ? new Cache("L1D", setup.l1d, l2.get(), setup.memoryLatency) : nullptr);
+    }
+
+    bool present() const // some access can take longer than a cycle
+    {
+        return l1i || l1d;
+    }
+
+    uint32_t fetch(uint32_t PC)
+    {
+        return l1i ? l1i->access(PC, false) : 1;
+    }
+
+    uint32_t data(uint32_t address, bool write, uint64_t cycle = 0)
+    {
+        if (!l1d)
+            return 1;
+        if (l1d->coherent()) // other cores' threads snoop this cache
+        {
+            lock_guard<mutex> guard(bus->lock);
+            return l1d->access(address, write, cycle);
+        }
+        return l1d->access(address, write, cycle);
+    }
+
+    Cache *dataCache() { return l1d.get(); } // nullptr without an L1D
+
+    void joinBus(CoherenceAgent &agent) // needs a write-back L1D
+    {
+        bus = &agent;
+        l1d->attach(agent);
+    }
+
+    template <typename F>
+    void forEachCache(F visit) const // present levels, L1I, L1D, L2
+    {
+        for (const unique_ptr<Cache> *c : {&l1i, &l1d, &l2})
+            if (*c)
+                visit(**c);
+    }
+
+    template <typename F>
+    void forEachCache(F visit)
+    {
+        for (unique_ptr<Cache> *c : {&l1i, &l1d, &l2})
+            if (*c)
+                visit(**c);
+    }
+
+    void save(ostream &out) const // line count per level (0 = absent), then the present levels
+    {
+        for (const unique_ptr<Cache> *c : {&l1i, &l1d, &l2})
+            putU32(out, *c ? (*c)->lines() : 0);
+        forEachCache([&](const Cache &c)
+                     { c.save(out); });
+    }
+
+    bool load(istream &in) // false if the saved hierarchy has a different shape
+    {
+        for (unique_ptr<Cache> *c : {&l1i, &l1d, &l2})
+            if (getU32(in) != (*c ? (*c)->lines() : 0))
+                return false;
+        for (unique_ptr<Cache> *c : {&l1i, &l1d, &l2})
+            if (*c)
+                (*c)->load(in);
+        return static_cast<bool>(in);
+    }
+
+private:
+    unique_ptr<Cache> l1i, l1d, l2;
+    CoherenceAgent *bus = nullptr;
+};
+
+#endif
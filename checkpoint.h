@@ -0,0 +1,121 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <iostream>
+#include <string>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include "pipeline.h"
+#include "sparse_memory.h"
+#include "trace_delta.h"
+
+using namespace std;
+
+// Binary checkpoint of a whole simulation, all integers little-endian:
+//   "RVCKPT06" | u8 core kind
+//   u64 cycle | u8 halted | state fields | nextState fields (STATE_FIELDS u32 each, see packState)
+//   32 u32 registers
+//   u32 counter count, u64 counters (core specific, in the core's own order)
+//   core specific microarchitectural state (predictor tables etc.), see ScalarCore::saveMicroarch
+//   u32 page count, then per page: u32 base address, SIM_PAGE_SIZE bytes
+// Only data memory pages with at least one non-zero byte are stored.
+
+static const char CHECKPOINT_MAGIC[8] = {'R', 'V', 'C', 'K', 'P', 'T', '0', '6'}; // 06: multiply/divide units and scoreboard in the five-stage state
+
+enum CheckpointCore : uint8_t
+{
+    CHECKPOINT_SINGLE_STAGE = 1,
+    CHECKPOINT_FIVE_STAGE = 2
+};
+
+void putU8(ostream &out, uint8_t v)
+{
+    out.put(static_cast<char>(v));
+}
+
+void putU32(ostream &out, uint32_t v)
+{
+    char b[4] = {char(v), char(v >> 8), char(v >> 16), char(v >> 24)};
+    out.write(b, 4);
+}
+
+void putU64(ostream &out, uint64_t v)
+{
+    putU32(out, static_cast<uint32_t>(v));
+    putU32(out, static_cast<uint32_t>(v >> 32));
+}
+
+uint8_t getU8(istream &in)
+{
+    return static_cast<uint8_t>(in.get());
+}
+
+uint32_t getU32(istream &in)
+{
+    uint8_t b[4] = {0, 0, 0, 0};
+    in.read(reinterpret_cast<char *>(b), 4);
+    return uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+}
+
+uint64_t getU64(istream &in)
+{
+    uint64_t lo = getU32(in);
+    uint64_t hi = getU32(in);
+    return lo | (hi << 32);
+}
+
+void putState(ostream &out, const stateStruct &s)
+{
+    uint32_t fields[STATE_FIELDS];
+    packState(s, fields);
+    for (int f = 0; f < STATE_FIELDS; f++)
+        putU32(out, fields[f]);
+}
+
+void getState(istream &in, stateStruct &s)
+{
+    uint32_t fields[STATE_FIELDS];
+    for (int f = 0; f < STATE_FIELDS; f++)
+        fields[f] = getU32(in);
+    unpackState(fields, s);
+}
+
+void putMemory(ostream &out, const SparseMemory &mem)
+{
+    uint32_t count = 0;
+    mem.forEachPage([&](uint32_t, const SparseMemory::Page &page)
+                    {
+                        for (uint8_t b : page)
+                            if (b != 0)
+                            {
+                                count++;
+                                return;
+                            } });
+    putU32(out, count);
+    mem.forEachPage([&](uint32_t base, const SparseMemory::Page &page)
+                    {
+                        for (uint8_t b : page)
+                            if (b != 0)
+                            {
+                                putU32(out, base);
+                                out.write(reinterpret_cast<const char *>(page.data()), page.size());
+                                return;
+                            } });
+}
+
+bool getMemory(istream &in, SparseMemory &mem) // replaces the whole contents of mem
+{
+    mem.clear();
+    uint32_t count = getU32(in);
+    SparseMemory::Page page;
+    for (uint32_t i = 0; i < count && in; i++)
+    {
+        uint32_t base = getU32(in);
+        in.read(reinterpret_cast<char *>(page.data()), page.size());
+        mem.writeBlock(base, page.data(), page.size());
+    }
+    return static_cast<bool>(in);
+}
+
+#endif
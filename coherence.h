@@ -0,0 +1,216 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include "cache.h"
+#include "counters.h"
+#include "console.h"
+
+using namespace std;
+
+// Snooping bus between the private L1Ds of several cores. Caches stay timing-only, the bus
+// decides what a miss or upgrade costs and changes the state of the other copies:
+//   BUS_READ            others drop M/E to S (a Modified copy supplies the data)
+//   BUS_READ_EXCLUSIVE  others invalidate (a Modified copy supplies the data)
+//   BUS_UPGRADE         others invalidate
+// With MSI a read miss always fills the line Shared; MESI fills it Exclusive when no other
+// cache has it, and a later write then needs no bus request.
+//
+// The bus serves one request at a time. A request arriving at cycle C starts at
+// max(C, end of the previous one) and holds the bus for transferLatency cycles; the
+// difference counts as contention. Each core runs on its own host thread; AccessOrder
+// below makes them take turns, so requests reach the bus ordered by (cycle, core id)
+// and every run with the same inputs gives the same cycle counts.
+
+enum CoherenceProtocol : uint8_t
+{
+    PROTOCOL_MSI,
+    PROTOCOL_MESI
+};
+
+bool parseCoherenceProtocol(const string &name, CoherenceProtocol &protocol)
+{
+    if (name == "msi")
+        protocol = PROTOCOL_MSI;
+    else if (name == "mesi")
+        protocol = PROTOCOL_MESI;
+    else
+        return false;
+    return true;
+}
+
+class CoherenceBus : public CoherenceAgent
+{
+public:
+    uint64_t reads = 0;           // BUS_READ requests
+    uint64_t readExclusives = 0;  // BUS_READ_EXCLUSIVE requests
+    uint64_t upgrades = 0;        // BUS_UPGRADE requests
+    uint64_t invalidations = 0;   // copies invalidated in other caches
+    uint64_t interventions = 0;   // requests answered by a Modified copy instead of the next level
+    uint64_t busyCycles = 0;      // cycles the bus spent on transfers
+    uint64_t contentionCycles = 0; // cycles requests waited for the bus
+    CounterRegistry counters;
+
+    CoherenceBus(CoherenceProtocol protocol, uint32_t transferLatency) : protocol{protocol}, transferLatency{transferLatency}
+    {
+        counters.add("bus.read", reads, "read misses broadcast on the bus");
+        counters.add("bus.read_exclusive", readExclusives, "write misses broadcast on the bus");
+        counters.add("bus.upgrade", upgrades, "writes to Shared lines broadcast on the bus");
+        counters.add("bus.invalidations", invalidations, "copies invalidated in other caches");
+        counters.add("bus.interventions", interventions, "requests served by another cache's Modified copy");
+        counters.add("bus.busy_cycles", busyCycles, "cycles the bus was transferring");
+        counters.add("bus.contention_cycles", contentionCycles, "cycles requests waited for the bus");
+    }
+
+    const char *protocolName() const { return protocol == PROTOCOL_MSI ? "MSI" : "MESI"; }
+
+    BusReply request(int port, BusRequest kind, uint32_t address, uint64_t cycle) // caller holds lock
+    {
+        uint64_t start = max(cycle, busyUntil);
+        busyUntil = start + transferLatency;
+        contentionCycles += start - cycle;
+        busyCycles += transferLatency;
+
+        if (kind == BUS_READ)
+            reads++;
+        else if (kind == BUS_READ_EXCLUSIVE)
+            readExclusives++;
+        else
+            upgrades++;
+
+        bool shared = false;
+        BusReply reply;
+        for (size_t p = 0; p < caches.size(); p++)
+        {
+            bool dirty;
+            if (int(p) == port || !caches[p]->snoop(address, kind != BUS_READ, dirty))
+                continue;
+            shared = true;
+            if (kind != BUS_READ)
+                invalidations++;
+            if (dirty)
+            {
+                interventions++;
+                reply.fromCache = true;
+            }
+        }
+
+        reply.latency = (start - cycle) + transferLatency;
+        reply.exclusive = kind != BUS_READ || (protocol == PROTOCOL_MESI && !shared);
+        return reply;
+    }
+
+    void outputMetrics(const string &basePath, uint64_t cycles, uint64_t instructions) // <basePath>.txt, .json and .csv
+    {
+        ofstream text(basePath + ".txt");
+        ofstream json(basePath + ".json");
+        ofstream csv(basePath + ".csv");
+        if (!text.is_open() || !json.is_open() || !csv.is_open())
+        {
+            console() << "Unable to open coherence metrics output files." << endl;
+            return;
+        }
+        text << "-----------------------------Coherence bus-----------------------------" << endl;
+        text << "#Protocol -> " << protocolName() << endl;
+        text << "#Cores -> " << caches.size() << endl;
+        text << "#Transfer latency -> " << transferLatency << endl;
+        text << "#Cycles (slowest core) -> " << cycles << endl;
+        text << "#Instructions (all cores) -> " << instructions << endl;
+        for (const CounterRegistry::Counter &c : counters.all())
+            text << "#" << c.description << " -> " << *c.value << endl;
+        text << "#Bus utilisation -> " << (cycles ? static_cast<float>(busyCycles) / cycles : 0.0f) << endl;
+        counters.writeJson(json, "bus", cycles, instructions);
+        counters.writeCsv(csv, cycles, instructions);
+    }
+
+private:
+    CoherenceProtocol protocol;
+    uint32_t transferLatency;
+    uint64_t busyUntil = 0; // cycle at which the current transfer ends
+};
+
+// Orders the cores' accesses to shared state (the bus, the other L1Ds and the shared
+// DataMem) by (cycle, core id), whatever the host threads do. Every core publishes the
+// cycle it has reached; before an access in cycle C core i waits until each lower id has
+// moved past C and each higher id has reached C. Published cycles only grow and the
+// smallest (cycle, id) pair can always go ahead, so nobody waits forever.
+class AccessOrder
+{
+public:
+    AccessOrder(unsigned cores) : cores{cores}, progress(new atomic<uint64_t>[cores])
+    {
+        for (unsigned i = 0; i < cores; i++)
+            progress[i].store(0);
+    }
+
+    void waitTurn(unsigned core, uint64_t cycle)
+    {
+        publish(core, cycle);
+        for (unsigned other = 0; other < cores; other++)
+            while (other != core && (other < core ? progress[other].load(memory_order_acquire) <= cycle
+                                                  : progress[other].load(memory_order_acquire) < cycle))
+                this_thread::yield();
+    }
+
+    void publish(unsigned core, uint64_t cycle) // core is done with every cycle before `cycle`
+    {
+        progress[core].store(cycle, memory_order_release);
+    }
+
+    void finish(unsigned core) // halted, it will not access anything again
+    {
+        publish(core, UINT64_MAX);
+    }
+
+private:
+    unsigned cores;
+    unique_ptr<atomic<uint64_t>[]> progress;
+};
+
+// Cores running on separate threads meet here at the end of every quantum. arrive()
+// returns true, to every core at once, when all of them had halted by then.
+class QuantumBarrier
+{
+public:
+    QuantumBarrier(unsigned parties) : parties{parties} {}
+
+    bool arrive(bool halted)
+    {
+        unique_lock<mutex> guard(lock);
+        uint64_t round = generation;
+        haltedCount += halted;
+        if (++arrived == parties)
+        {
+            allHalted = haltedCount == parties;
+            arrived = 0;
+            haltedCount = 0;
+            generation++;
+            released.notify_all();
+        }
+        else
+            released.wait(guard, [&]
+                          { return generation != round; });
+        return allHalted;
+    }
+
+private:
+    mutex lock;
+    condition_variable released;
+    unsigned parties;
+    unsigned arrived = 0;
+    unsigned haltedCount = 0;
+    uint64_t generation = 0;
+    bool allHalted = false;
+};
+
+#endif
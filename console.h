@@ -0,0 +1,18 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <iostream>
+
+using namespace std;
+
+// Destination for the simulator's diagnostic messages (hazards, halts, load errors).
+// It is per thread: a normal run prints to cout, while each batch worker points it
+// at the current job's log file so concurrent jobs never interleave their output.
+thread_local ostream *simConsole = &cout;
+
+ostream &console()
+{
+    return *simConsole;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef COSIM_H
+#define COSIM_H
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <bitset>
+#include <cstdint>
+#include "spsc_ring.h"
+
+using namespace std;
+
+// Differential co-simulation (--cosim). The core under test pushes one CommitRecord
+// per retired instruction; a reference core on another thread replays the program
+// and compares its own record for the same instruction.
+
+struct CommitRecord // architectural effect of one retired instruction
+{
+    uint32_t PC = 0;
+    uint32_t Wrt_data = 0;   // value written to rd
+    uint32_t Store_addr = 0; // word written to memory
+    uint32_t Store_data = 0;
+    uint32_t cycle = 0;      // cycle it retired in, only for the report
+    uint8_t rd = 0;
+    bool wrt_enable = false; // rd was written (never set for x0)
+    bool wrt_mem = false;
+};
+
+bool sameCommit(const CommitRecord &a, const CommitRecord &b)
+{
+    if (a.PC != b.PC || a.wrt_enable != b.wrt_enable || a.wrt_mem != b.wrt_mem)
+        return false;
+    if (a.wrt_enable && (a.rd != b.rd || a.Wrt_data != b.Wrt_data))
+        return false;
+    if (a.wrt_mem && (a.Store_addr != b.Store_addr || a.Store_data != b.Store_data))
+        return false;
+    return true;
+}
+
+void formatCommit(ostream &out, const CommitRecord &rec)
+{
+    out << "PC " << rec.PC << " (cycle " << rec.cycle << ")";
+    if (rec.wrt_enable)
+        out << ", x" << int(rec.rd) << " <- " << bitset<32>(rec.Wrt_data);
+    if (rec.wrt_mem)
+        out << ", MEM[" << rec.Store_addr << "] <- " << bitset<32>(rec.Store_data);
+    if (!rec.wrt_enable && !rec.wrt_mem)
+        out << ", no architectural write";
+}
+
+class CommitStream // single producer (core under test), single consumer (reference)
+{
+public:
+    CommitStream() : ring(1 << 14) {}
+
+    void push(const CommitRecord &rec)
+    {
+        while (!ring.tryPush(rec))
+        {
+            if (stopped.load(memory_order_relaxed)) // reference gave up, nobody will drain the ring
+                return;
+            this_thread::yield();
+        }
+    }
+
+    void finish() // producer: no more records will follow
+    {
+        finished.store(true, memory_order_release);
+    }
+
+    bool pop(CommitRecord &rec) // consumer: waits for the next record, false once the stream is finished and drained
+    {
+        while (!ring.tryPop(rec))
+        {
+            if (finished.load(memory_order_acquire) && ring.empty())
+                return false;
+            this_thread::yield();
+        }
+        return true;
+    }
+
+    void stop() // consumer: divergence found, the producer can stop early
+    {
+        stopped.store(true, memory_order_release);
+    }
+
+    bool diverged() const
+    {
+        return stopped.load(memory_order_acquire);
+    }
+
+private:
+    SpscRing<CommitRecord> ring;
+    atomic<bool> finished{false};
+    atomic<bool> stopped{false};
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// Named 64-bit performance counters. The values stay ordinary uint64_t members of the
+// stages and models that own them, so counting is a plain increment; the registry only
+// remembers where each one lives so they can all be listed, dumped and checkpointed.
+//
+// Names are dotted paths, e.g. "stall.load_use" or "L1D.misses".
+
+class CounterRegistry
+{
+public:
+    struct Counter
+    {
+        string name;
+        string description;
+        uint64_t *value;
+    };
+
+    void add(const string &name, uint64_t &value, const string &description = "")
+    {
+        counters.push_back({name, description, &value});
+    }
+
+    const vector<Counter> &all() const { return counters; }
+
+    uint64_t *find(const string &name) const // nullptr if no counter has that name
+    {
+        for (const Counter &c : counters)
+            if (c.name == name)
+                return c.value;
+        return nullptr;
+    }
+
+    // {"core": ..., "cycles": ..., "instructions": ..., "counters": {"name": value, ...}}
+    void writeJson(ostream &out, const string &core, uint64_t cycles, uint64_t instructions) const
+    {
+        out << "{\n";
+        out << "  \"core\": \"" << jsonEscape(core) << "\",\n";
+        out << "  \"cycles\": " << cycles << ",\n";
+        out << "  \"instructions\": " << instructions << ",\n";
+        out << "  \"counters\": {";
+        for (size_t i = 0; i < counters.size(); i++)
+            out << (i ? ",\n" : "\n") << "    \"" << jsonEscape(counters[i].name) << "\": " << *counters[i].value;
+        out << (counters.empty() ? "}\n" : "\n  }\n");
+        out << "}\n";
+    }
+
+    // one row per counter, cycles and instructions first
+    void writeCsv(ostream &out, uint64_t cycles, uint64_t instructions) const
+    {
+        out << "counter,value,description\n";
+        out << "cycles," << cycles << ",simulated cycles\n";
+        out << "instructions," << instructions << ",retired instructions\n";
+        for (const Counter &c : counters)
+            out << c.name << "," << *c.value << "," << csvEscape(c.description) << "\n";
+    }
+
+private:
+    static string jsonEscape(const string &s)
+    {
+        string escaped;
+        for (char ch : s)
+        {
+            if (ch == '"' || ch == '\\')
+                escaped += '\\';
+            escaped += ch;
+        }
+        return escaped;
+    }
+
+    static string csvEscape(const string &s)
+    {
+        if (s.find_first_of(",\"") == string::npos)
+            return s;
+        string quoted = "\"";
+        for (char ch : s)
+        {
+            if (ch == '"')
+                quoted += '"';
+            quoted += ch;
+        }
+        return quoted + "\"";
+    }
+
+    vector<Counter> counters;
+};
+
+#endif
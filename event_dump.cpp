@@ -0,0 +1,45 @@
+// Prints a binary event log (FS_Events.bin, written by builds with SIM_LOG_CATEGORIES set) as text.
+// Usage: ./event_dump <Events.bin> [category mask]
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "events.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        cout << "Usage: ./event_dump <Events.bin> [category mask]" << endl;
+        return -1;
+    }
+    unsigned mask = argc == 3 ? stoul(argv[2], nullptr, 0) : LOG_ALL;
+
+    ifstream in(argv[1], ios::binary);
+    char magic[sizeof(EVENT_MAGIC)];
+    if (!in.is_open() || !in.read(magic, sizeof(magic)) || memcmp(magic, EVENT_MAGIC, sizeof(magic)) != 0)
+    {
+        cout << argv[1] << " is not an event log." << endl;
+        return -1;
+    }
+
+    uint64_t header[2] = {0, 0}; // dropped, count
+    for (uint64_t &value : header)
+        for (int i = 0; i < 8; i++)
+            value |= uint64_t(static_cast<uint8_t>(in.get())) << (8 * i);
+    if (header[0] > 0)
+        cout << "(" << header[0] << " older events were overwritten)" << endl;
+
+    Event e;
+    for (uint64_t i = 0; i < header[1] && readEvent(in, e); i++)
+    {
+        if (e.category & mask)
+        {
+            formatEvent(cout, e);
+            cout << '\n';
+        }
+    }
+    return 0;
+}
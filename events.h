@@ -0,0 +1,232 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Structured event log for the per-cycle diagnostics (decode details, hazards, branch
+// resolution, ...). Which categories exist in a build, and from which level up, is fixed
+// at compile time:
+//   -DSIM_LOG_CATEGORIES=LOG_ALL           everything (debug build)
+//   -DSIM_LOG_CATEGORIES="LOG_PIPELINE|LOG_BRANCH" -DSIM_LOG_LEVEL=LOG_INFO
+// The default is no categories, and then every SIM_EVENT is a discarded `if constexpr`
+// branch: its arguments are type-checked but no code is generated for them.
+//
+// Enabled events are stored as fixed-size binary records in the owning core's EventLog
+// (a ring of the newest SIM_EVENT_BUFFER records) and written to <core>_Events.bin at the
+// end of the run. event_dump.cpp turns that file back into text.
+
+#define LOG_DECODE 0x01   // checkInstr field dumps
+#define LOG_PIPELINE 0x02 // cycle boundaries, stalls, halts
+#define LOG_BRANCH 0x04   // branch/jump resolution and redirects
+#define LOG_REGFILE 0x08  // suspicious register file accesses
+#define LOG_ALL 0xFF
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+
+#ifndef SIM_LOG_CATEGORIES
+#define SIM_LOG_CATEGORIES 0
+#endif
+
+#ifndef SIM_LOG_LEVEL
+#define SIM_LOG_LEVEL LOG_DEBUG
+#endif
+
+#ifndef SIM_EVENT_BUFFER
+#define SIM_EVENT_BUFFER (1u << 20) // records kept per core, older ones are overwritten
+#endif
+
+enum EventKind : uint16_t
+{
+    EV_CYCLE,            // a: cycle
+    EV_DECODE,           // a: instruction word, b: format letter (I, R, S, B, U, J)
+    EV_LOAD_USE_STALL,   // a: EX.rd, b: rs1, c: rs2 of the instruction held in ID
+    EV_BRANCH,           // a: PC, b: taken, c: next PC
+    EV_JUMP,             // a: PC, b: rd, c: target
+    EV_REDIRECT,         // a: PC of the mispredicted instruction, b: correct next PC
+    EV_HALT,             // a: PC
+    EV_X0_WRITE,         // a: value
+    EV_REG_OUT_OF_RANGE, // a: register number
+    EV_IDLE_SKIP,        // a: first cycle, b: number of quiescent cycles jumped over; those cycles get no EV_CYCLE
+    EV_TRAP              // a: PC, b: TrapCause, c: instruction word
+};
+
+struct Event // 20 bytes on disk, little-endian, in this field order
+{
+    uint32_t cycle;
+    uint8_t category;
+    uint8_t level;
+    uint16_t kind;
+    uint32_t a, b, c;
+};
+
+static const char EVENT_MAGIC[8] = {'R', 'V', 'E', 'V', 'T', '0', '0', '1'};
+
+constexpr bool simEventEnabled(unsigned category, unsigned level)
+{
+    return (SIM_LOG_CATEGORIES & category) != 0 && level >= SIM_LOG_LEVEL;
+}
+
+class EventLog
+{
+public:
+    uint32_t cycle = 0; // stamped into every record, set by SIM_EVENT_SCOPE
+
+    void record(uint8_t category, uint8_t level, uint16_t kind, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+    {
+        if (ring.empty())
+            ring.resize(SIM_EVENT_BUFFER);
+        ring[total % ring.size()] = {cycle, category, level, kind, a, b, c};
+        total++;
+    }
+
+    uint64_t size() const { return total < ring.size() ? total : ring.size(); }
+    uint64_t dropped() const { return total - size(); }
+
+    bool write(const string &path) const // magic, u64 dropped, u64 count, records oldest first
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out.is_open())
+            return false;
+        out.write(EVENT_MAGIC, sizeof(EVENT_MAGIC));
+        putLE(out, dropped(), 8);
+        putLE(out, size(), 8);
+        for (uint64_t i = total - size(); i < total; i++)
+        {
+            const Event &e = ring[i % ring.size()];
+            putLE(out, e.cycle, 4);
+            putLE(out, e.category, 1);
+            putLE(out, e.level, 1);
+            putLE(out, e.kind, 2);
+            putLE(out, e.a, 4);
+            putLE(out, e.b, 4);
+            putLE(out, e.c, 4);
+        }
+        return out.good();
+    }
+
+private:
+    static void putLE(ostream &out, uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            out.put(static_cast<char>(v >> (8 * i)));
+    }
+
+    vector<Event> ring; // allocated on the first record, so builds without events never pay for it
+    uint64_t total = 0;
+};
+
+thread_local EventLog fallbackEvents;             // events raised outside any core (checkInstr called directly)
+thread_local EventLog *simEvents = &fallbackEvents; // log of the core running on this thread
+
+struct EventScope // routes this thread's events to one core's log for the duration of a step
+{
+    EventLog *previous;
+    EventScope(EventLog &log, uint32_t cycle) : previous{simEvents}
+    {
+        log.cycle = cycle;
+        simEvents = &log;
+    }
+    ~EventScope() { simEvents = previous; }
+};
+
+#define SIM_EVENT(category, level, ...)                             \
+    do                                                              \
+    {                                                               \
+        if constexpr (simEventEnabled(category, level))             \
+            simEvents->record(category, level, __VA_ARGS__);        \
+    } while (0)
+
+#if SIM_LOG_CATEGORIES
+#define SIM_EVENT_SCOPE(log, cycle) EventScope simEventScope(log, cycle)
+#else
+#define SIM_EVENT_SCOPE(log, cycle) ((void)0)
+#endif
+
+bool readEvent(istream &in, Event &e)
+{
+    uint8_t b[20];
+    if (!in.read(reinterpret_cast<char *>(b), sizeof(b)))
+        return false;
+    auto u32 = [&](int at)
+    { return uint32_t(b[at]) | uint32_t(b[at + 1]) << 8 | uint32_t(b[at + 2]) << 16 | uint32_t(b[at + 3]) << 24; };
+    e.cycle = u32(0);
+    e.category = b[4];
+    e.level = b[5];
+    e.kind = uint16_t(b[6] | b[7] << 8);
+    e.a = u32(8);
+    e.b = u32(12);
+    e.c = u32(16);
+    return true;
+}
+
+void formatEvent(ostream &out, const Event &e) // one line, wording as the old console messages
+{
+    static const char *const levels[] = {"debug", "info", "warn", "error"};
+    out << "[" << e.cycle << "] " << (e.level < 4 ? levels[e.level] : "?") << ": ";
+    switch (e.kind)
+    {
+    case EV_CYCLE:
+        out << "---------------- Cycle: " << e.a << " ----------------";
+        break;
+    case EV_DECODE:
+    {
+        uint32_t w = e.a;
+        out << char(e.b) << "-Type detected, instruction " << bitset<32>(w) << ", opcode " << bitset<7>(w & 0x7F);
+        if (e.b != 'S' && e.b != 'B')
+            out << ", rd " << bitset<5>(w >> 7);
+        if (e.b != 'J' && e.b != 'U')
+            out << ", funct3 " << bitset<3>(w >> 12) << ", rs1 " << bitset<5>(w >> 15);
+        if (e.b == 'R' || e.b == 'S' || e.b == 'B')
+            out << ", rs2 " << bitset<5>(w >> 20);
+        if (e.b == 'R')
+            out << ", funct7 " << bitset<7>(w >> 25);
+        break;
+    }
+    case EV_LOAD_USE_STALL:
+        out << "Hazard detected. Stalling pipeline. EX.rd: " << bitset<5>(e.a) << " Fields.rs1: " << bitset<5>(e.b)
+            << " Fields.rs2: " << bitset<5>(e.c);
+        break;
+    case EV_BRANCH:
+        out << "Branch at PC=" << bitset<32>(e.a) << " " << (e.b ? "Taken" : "Not Taken") << ", New PC=" << bitset<32>(e.c);
+        break;
+    case EV_JUMP:
+        out << "Jump at PC=" << bitset<32>(e.a) << " to PC=" << bitset<32>(e.c);
+        if (e.b != 0)
+            out << ", writing return address to Register[" << bitset<5>(e.b) << "] = " << bitset<32>(e.a + 4);
+        break;
+    case EV_REDIRECT:
+        out << "Misprediction at PC=" << bitset<32>(e.a) << ", flushing and refetching from PC=" << bitset<32>(e.b);
+        break;
+    case EV_HALT:
+        out << "HALT fetched at PC=" << bitset<32>(e.a) << ": Pipeline stopping.";
+        break;
+    case EV_X0_WRITE:
+        out << "Warning: Attempt to write " << e.a << " to register 0.";
+        break;
+    case EV_REG_OUT_OF_RANGE:
+        out << "Error: Register address " << e.a << " is out of range.";
+        break;
+    case EV_IDLE_SKIP:
+        out << "Pipeline idle, skipping " << e.b << " cycles from cycle " << e.a;
+        break;
+    case EV_TRAP:
+        out << "Trap " << e.b << " at PC=" << bitset<32>(e.a) << ", instruction " << bitset<32>(e.c) << ": core stopped.";
+        break;
+    default:
+        out << "unknown event " << e.kind << " (" << e.a << ", " << e.b << ", " << e.c << ")";
+        break;
+    }
+}
+
+#endif
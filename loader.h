@@ -0,0 +1,215 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <bitset>
+#include <fstream>
+#include <functional>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include "console.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOADER_HAVE_MMAP 1
+#endif
+
+using namespace std;
+
+// Memory images can be given in three formats, tried in this order:
+//   <base>.bin  raw bytes, byte i of the file is memory address i (same order as the text format)
+//   <base>.elf  ELF32 executable, PT_LOAD segments are placed at their virtual address
+//   <base>.txt  one 8-bit binary string per line (original format)
+// The two binary formats are mapped with mmap so there is no parse step.
+
+typedef function<void(uint32_t address, const uint8_t *data, size_t length)> ImageWriter;
+
+string joinPath(const string &dir, const string &file) // portable "<dir>/<file>", no separator for an empty dir
+{
+    if (dir.empty())
+        return file;
+    return (filesystem::path(dir) / file).string();
+}
+
+class MappedFile // read-only view of a whole file, unmapped when it goes out of scope
+{
+public:
+    MappedFile(const string &path)
+    {
+#ifdef LOADER_HAVE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+        {
+            if (st.st_size == 0)
+            {
+                empty = true; // mmap refuses zero-length files, treat it as an empty image
+            }
+            else
+            {
+                void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED)
+                {
+                    mapped = static_cast<const uint8_t *>(p);
+                    length = st.st_size;
+                }
+            }
+        }
+        close(fd);
+#else
+        ifstream in(path, ios::binary);
+        if (!in.is_open())
+            return;
+        fallback.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        mapped = reinterpret_cast<const uint8_t *>(fallback.data());
+        length = fallback.size();
+        empty = fallback.empty();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef LOADER_HAVE_MMAP
+        if (mapped)
+            munmap(const_cast<uint8_t *>(mapped), length);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const { return mapped != nullptr || empty; }
+    const uint8_t *data() const { return mapped; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t *mapped = nullptr;
+    size_t length = 0;
+    bool empty = false;
+#ifndef LOADER_HAVE_MMAP
+    vector<char> fallback;
+#endif
+};
+
+bool loadRawImage(const string &path, const ImageWriter &write)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+    if (file.size() > 0)
+        write(0, file.data(), file.size());
+    return true;
+}
+
+bool loadElfImage(const string &path, const ImageWriter &write)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+
+    const uint8_t *elf = file.data();
+    if (file.size() < 52 || memcmp(elf, "\x7f" "ELF", 4) != 0 || elf[4] != 1) // ELFCLASS32 only
+    {
+        console() << "Unsupported ELF image: " << path << endl;
+        return false;
+    }
+
+    bool little = (elf[5] == 1); // ELFDATA2LSB
+    auto half = [&](size_t off) -> uint32_t
+    { return little ? (elf[off] | elf[off + 1] << 8) : (elf[off] << 8 | elf[off + 1]); };
+    auto word = [&](size_t off) -> uint32_t
+    {
+        return little ? (uint32_t(elf[off]) | uint32_t(elf[off + 1]) << 8 | uint32_t(elf[off + 2]) << 16 | uint32_t(elf[off + 3]) << 24)
+                      : (uint32_t(elf[off]) << 24 | uint32_t(elf[off + 1]) << 16 | uint32_t(elf[off + 2]) << 8 | uint32_t(elf[off + 3]));
+    };
+
+    uint32_t phoff = word(28);
+    uint32_t phentsize = half(42);
+    uint32_t phnum = half(44);
+
+    for (uint32_t seg = 0; seg < phnum; seg++)
+    {
+        size_t ph = phoff + size_t(seg) * phentsize;
+        if (ph + 32 > file.size())
+            break;
+        if (word(ph) != 1) // PT_LOAD
+            continue;
+
+        uint32_t offset = word(ph + 4);
+        uint32_t vaddr = word(ph + 8);
+        uint32_t filesz = word(ph + 16);
+        if (size_t(offset) + filesz > file.size())
+        {
+            console() << "Truncated ELF segment in " << path << endl;
+            return false;
+        }
+
+        if (!little)
+        {
+            write(vaddr, elf + offset, filesz);
+            continue;
+        }
+
+        // The simulator keeps words most significant byte first, so little-endian
+        // segments are byte-swapped within each word on the way in.
+        const uint8_t *src = elf + offset;
+        uint32_t i = 0;
+        for (; i < filesz && ((vaddr + i) & 3); i++) // bytes before the first word boundary
+            write((vaddr + i) ^ 3, &src[i], 1);
+
+        uint8_t swapped[4096];
+        while (filesz - i >= 4)
+        {
+            uint32_t n = min<uint32_t>((filesz - i) & ~3u, sizeof(swapped));
+            for (uint32_t b = 0; b < n; b += 4)
+            {
+                swapped[b] = src[i + b + 3];
+                swapped[b + 1] = src[i + b + 2];
+                swapped[b + 2] = src[i + b + 1];
+                swapped[b + 3] = src[i + b];
+            }
+            write(vaddr + i, swapped, n);
+            i += n;
+        }
+
+        for (; i < filesz; i++) // bytes after the last whole word
+            write((vaddr + i) ^ 3, &src[i], 1);
+    }
+    return true;
+}
+
+bool loadTextImage(const string &path, const ImageWriter &write)
+{
+    ifstream in(path);
+    if (!in.is_open())
+        return false;
+
+    string line;
+    uint32_t address = 0;
+    while (getline(in, line))
+    {
+        uint8_t byte = static_cast<uint8_t>(bitset<8>(line).to_ulong());
+        write(address, &byte, 1);
+        address++;
+    }
+    return true;
+}
+
+bool loadMemoryImage(const string &ioDir, const string &base, const ImageWriter &write) // false if no image was found
+{
+    return loadRawImage(joinPath(ioDir, base + ".bin"), write) ||
+           loadElfImage(joinPath(ioDir, base + ".elf"), write) ||
+           loadTextImage(joinPath(ioDir, base + ".txt"), write);
+}
+
+#endif
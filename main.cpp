@@ -4,134 +4,81 @@
 #include <bitset>
 #include <fstream>
 #include <stdint.h>
+#include <cstdio>
+#include <array>
+#include <utility>
+#include <typeinfo>
+#include <type_traits>
+#include <limits>
 #include "type_SE.h"
+#include "loader.h"
+#include "pipeline.h"
+#include "sparse_memory.h"
+#include "trace.h"
+#include "checkpoint.h"
+#include "console.h"
+#include "batch.h"
+#include "cosim.h"
+#include "block_cache.h"
+#include "branch_predictor.h"
+#include "cache.h"
+#include "counters.h"
+#include "profiler.h"
+#include "coherence.h"
+#include "scoreboard.h"
 
 
 using namespace std;
 
-#define MemSize 1000 // Memory Size
+#ifndef SS_THREADED_DISPATCH // computed goto for the single-stage interpreter, GCC/Clang extension
+#if defined(__GNUC__) || defined(__clang__)
+#define SS_THREADED_DISPATCH 1
+#else
+#define SS_THREADED_DISPATCH 0
+#endif
+#endif
 
-struct IFStruct
-{
-    bitset<32> PC;
-    bool nop;
-};
-
-struct IDStruct
-{
-    bitset<32> Instr;
-    bool nop = true;
-};
-
-struct EXStruct
-{
-    bitset<32> Read_data1;
-    bitset<32> Read_data2;
-    bitset<12> Imm_I;
-    bitset<12> Imm_S;
-    bitset<12> Imm_B;
-    bitset<20> Imm_U;
-    bitset<20> Imm_J;
-    bitset<32> Imm;
-    bitset<5> rs1;
-    bitset<5> rs2;
-    bitset<5> rd;
-    bitset<3> func3;
-    bitset<7> func7;
-    bitset<32> Instr;
-    bool rd_mem = false;
-    bool wrt_mem = false;
-    bool alu_op = false;
-    bool wrt_enable = false;
-    bool nop = true;
-    bool is_I_type = false;
-};
-
-struct MEMStruct
-{
-    bitset<32> ALUresult;
-    bitset<32> Store_data;
-    bitset<5> rs1;
-    bitset<5> rs2;
-    bitset<5> rd;
-    bool rd_mem = false;
-    bool wrt_mem = false;
-    bool wrt_enable = false;
-    bool nop = true;
-};
-
-struct WBStruct
-{
-    bitset<32> Wrt_data;
-    bitset<5> rs1;
-    bitset<5> rs2;
-    bitset<5> rd;
-    bool wrt_enable;
-    bool nop = true;
-};
-
-struct stateStruct
-{
-    IFStruct IF;
-    IDStruct ID;
-    EXStruct EX;
-    MEMStruct MEM;
-    WBStruct WB;
-};
+#define MemSize 1000 // Bytes of data memory dumped to DMEMResult.txt (memory itself spans the full 32-bit space)
 
 class InsMem
 {
 public:
     string id, ioDir;
-    InsMem(string name, string ioDir) // Reads instructions from a file, storing each byte as an 8-bit bitset. Formatting.
+    bool loaded; // false if no imem image was found
+    InsMem(string name, string ioDir) // Loads the instruction image into sparse byte pages
     {
         id = name;
-        IMem.resize(MemSize);
-        ifstream imem;
-        string line;
-        int i = 0;
-        imem.open(ioDir + "\\imem.txt");
-        if (imem.is_open())
-        {
-            while (getline(imem, line))
-            {
-                IMem[i] = bitset<8>(line);
-                i++;
-            }
-        }
-        else
-            cout << "Unable to open IMEM input file.";
-        imem.close();
+        loaded = loadMemoryImage(ioDir, "imem", [this](uint32_t address, const uint8_t *data, size_t length)
+                                      { IMem.writeBlock(address, data, length); });
+        if (!loaded)
+            console() << "Unable to open IMEM input file.";
     }
 
-    bitset<32> readInstr(bitset<32> ReadAddress) // combines 4 8-bit entries (models fetching), bounds protect against out of range
+    uint32_t readInstr(uint32_t ReadAddress) // fetches the 4 bytes at ReadAddress as one word, untouched memory reads as 0
     {
+        return IMem.readWord(ReadAddress);
+    }
 
-        int start_address;         // for identifying the starting address of the 32 bit bitset
-        bitset<32> instruction(0); // the final combined bitset when the 4 bytes are combined
-
-        start_address = ReadAddress.to_ulong(); // converting the hex start address to a long, (i.e. 0x00000000 --> 0, 0x00000004 --> 4)
-
-        if (start_address + 3 < IMem.size()) // error checking to make sure we dont go out of bounds with MemSize
-        {
-            instruction = (IMem[start_address].to_ulong() << 24 |     // taking the 8 bits at starting address, shifting them 24 left				--> MSB
-                           IMem[start_address + 1].to_ulong() << 16 | // taking the next 8 bits at starting address + 1, shifting them 16 left
-                           IMem[start_address + 2].to_ulong() << 8 |  // taking the next 8 bits at starting address + 2, shifting them 8 left
-                           IMem[start_address + 3].to_ulong());       // taking the last 8 bits at starting address + 3, maintining position		--> LSB
-        }
-        else
+    const MicroOp &decodeAt(uint32_t PC) // predecoded instruction at PC, decoded on first fetch and cached after that
+    {
+        MicroOp &uop = (*decodeCache.get(PC >> SIM_PAGE_BITS, true))[(PC & SIM_PAGE_MASK) >> 2];
+        if (!uop.valid)
         {
-            printf("Error(ri): Address is out of range."); // error checking feedback
-            cout << "Accessing IMem at address: " << start_address << endl;
-
-            return bitset<32>(0); // returning empty 32 bit bitset if OAB
+            uop = predecode(readInstr(PC));
         }
+        return uop;
+    }
 
-        return instruction; // returning the combined 32 bit bitset
+    TranslatedBlock *blockAt(uint32_t PC) // basic block starting at PC, see block_cache.h
+    {
+        return blockCache.lookup(PC, [this](uint32_t address) -> const MicroOp &
+                                 { return decodeAt(address); });
     }
 
 private:
-    vector<bitset<8>> IMem; // Streams of 8 bits, to then be used by readInstr
+    SparseMemory IMem;                                        // instruction bytes
+    PageMap<array<MicroOp, SIM_PAGE_SIZE / 4>> decodeCache;   // one MicroOp per instruction word, paged like IMem
+    BlockCache blockCache;                                    // translated blocks, built from decodeCache
 };
 
 class DataMem // Used to access and update data that has already been stored
@@ -139,78 +86,48 @@ class DataMem // Used to access and update data that has already been stored
 public:
     string id, opFilePath, ioDir;
 
-    DataMem(string name, string ioDir) : id{name}, ioDir{ioDir}
+    DataMem(string name, string ioDir, string outDir = "") : id{name}, ioDir{ioDir} // outDir defaults to ioDir
     {
-        DMem.resize(MemSize);
-        opFilePath = ioDir + "\\" + name + "_DMEMResult.txt";
-        ifstream dmem;
-        string line;
-        int i = 0;
-        dmem.open(ioDir + "\\dmem.txt");
-        if (dmem.is_open())
-        {
-            while (getline(dmem, line) && i < MemSize)
-            {
-                DMem[i] = bitset<8>(line);
-                i++;
-            }
-            dmem.close();
-        }
-        else
-            cout << "Unable to open DMEM input file.";
+        opFilePath = joinPath(outDir.empty() ? ioDir : outDir, name + "_DMEMResult.txt");
+        bool loaded = loadMemoryImage(ioDir, "dmem", [this](uint32_t address, const uint8_t *data, size_t length)
+                                      { DMem.writeBlock(address, data, length); });
+        if (!loaded)
+            console() << "Unable to open DMEM input file.";
     }
 
-    void printDMemState(int start = 0, int end = 16) const
+    void printDMemState(int start = 0, int end = 16)
     { // debug function to help see state of dmem
-        cout << "(Inside printDMemState) Current state of DMem:" << endl;
-        for (int i = start; i < end && i < DMem.size(); ++i)
+        console() << "(Inside printDMemState) Current state of DMem:" << endl;
+        for (int i = start; i < end; ++i)
         {
-            cout << "DMem[" << i << "]: " << DMem[i] << endl;
+            console() << "DMem[" << i << "]: " << bitset<8>(DMem.readByte(i)) << endl;
         }
     }
 
-    bitset<32> readDataMem(bitset<32> Address) // fetches data from memory
+    uint32_t readDataMem(uint32_t Address, int bytes = 4) // fetches a word, halfword (2) or byte (1) from memory, zero-extended
     {
-
-        int start_address;      // for identifying the starting address of the 32 bit bitset
-        bitset<32> data_val(0); // the final combined bitset when the 4 bytes are combined
-
-        start_address = Address.to_ulong(); // converting the hex start address to a long, (i.e. 0x00000000 --> 0, 0x00000004 --> 4)
-
-        if (start_address + 3 < DMem.size()) // error checking to make sure we dont go out of bounds with MemSize
-        {
-            data_val = (DMem[start_address].to_ulong() << 24 |     // taking the 8 bits at starting address, shifting them 24 left				--> MSB
-                        DMem[start_address + 1].to_ulong() << 16 | // taking the next 8 bits at starting address + 1, shifting them 16 left
-                        DMem[start_address + 2].to_ulong() << 8 |  // taking the next 8 bits at starting address + 2, shifting them 8 left
-                        DMem[start_address + 3].to_ulong());       // taking the last 8 bits at starting address + 3, maintining position		--> LSB
-        }
-        else
+        if (lock)
         {
-            printf("Error(rdm): Address is out of range."); // error checking feedback
-            cout << "Accessing IMem at address: " << start_address << endl;
-
-            return bitset<32>(0); // returning empty 32 bit bitset if OAB
+            lock_guard<mutex> guard(*lock);
+            return DMem.read(Address, bytes);
         }
-
-        return data_val; // returning the combined 32 bit bitset
+        return DMem.read(Address, bytes);
     }
 
-    void writeDataMem(bitset<32> Address, bitset<32> WriteData)
+    void writeDataMem(uint32_t Address, uint32_t WriteData, int bytes = 4) // stores the low `bytes` bytes of WriteData
     {
-        int start_address = Address.to_ulong();
-
-        if (start_address + 3 < DMem.size())
-        {
-            // Writing each byte of the 32-bit data into consecutive line, using mshifts and masks to extract
-            DMem[start_address] = bitset<8>((WriteData.to_ulong() >> 24) & 0xFF);
-            DMem[start_address + 1] = bitset<8>((WriteData.to_ulong() >> 16) & 0xFF);
-            DMem[start_address + 2] = bitset<8>((WriteData.to_ulong() >> 8) & 0xFF);
-            DMem[start_address + 3] = bitset<8>(WriteData.to_ulong() & 0xFF);
-        }
-        else
+        if (lock)
         {
-            cout << "Error(wdm): Address is out of range. Accessing IMem at address: " << start_address << endl;
+            lock_guard<mutex> guard(*lock);
+            DMem.write(Address, WriteData, bytes);
+            return;
         }
+        DMem.write(Address, WriteData, bytes);
+    }
+
+    void shareBetweenThreads() // --cores: every core's MEM stage accesses this memory from its own thread
+    {
+        lock.reset(new mutex());
     }
 
     void outputDataMem()
@@ -219,9 +136,9 @@ public:
         ofstream dmemout(opFilePath, std::ios_base::trunc);
         if (dmemout.is_open())
         {
-            for (int j = 0; j < DMem.size(); j++)
+            for (int j = 0; j < MemSize; j++)
             {
-                dmemout << DMem[j].to_string() << endl;
+                dmemout << bitset<8>(DMem.readByte(j)).to_string() << endl;
                 // if (j < 16) {  // debug
                 //     cout << "Memory[" << j << "]: " << DMem[j] << endl;
                 // }
@@ -231,12 +148,23 @@ public:
         }
         else
         {
-            cout << "Unable to open " << opFilePath << " for writing." << endl;
+            console() << "Unable to open " << opFilePath << " for writing." << endl;
         }
     }
 
+    void saveContents(ostream &out) const // non-zero pages only, see checkpoint.h
+    {
+        putMemory(out, DMem);
+    }
+
+    bool loadContents(istream &in)
+    {
+        return getMemory(in, DMem);
+    }
+
 private:
-    vector<bitset<8>> DMem;
+    SparseMemory DMem;
+    unique_ptr<mutex> lock; // only when shared between threads
 };
 
 class RegisterFile
@@ -245,67 +173,62 @@ public:
     string outputFile;
     RegisterFile(string ioDir) : outputFile{ioDir + "RFResult.txt"}
     {
-        Registers.resize(32);
-        Registers[0] = bitset<32>(0);
+        Registers.fill(0);
     }
 
-    bitset<32> readRF(bitset<5> Reg_addr) // reads data from a specified register
+    uint32_t readRF(uint8_t Reg_addr) // reads data from a specified register
     {
 
-        if (Reg_addr.to_ulong() < Registers.size()) // checking if Reg_addr param is with in the valid register range of 0-31
+        if (Reg_addr < Registers.size()) // checking if Reg_addr param is with in the valid register range of 0-31
         {
-            return Registers[Reg_addr.to_ulong()]; // returning the contents of the register specified
+            return Registers[Reg_addr]; // returning the contents of the register specified
         }
         else
         {
-            printf("Error: Register address is out of range."); // giving error if the register given is out of range
+            SIM_EVENT(LOG_REGFILE, LOG_ERROR, EV_REG_OUT_OF_RANGE, Reg_addr); // giving error if the register given is out of range
 
-            return bitset<32>(0); // returning empty bitset as feedback error value
+            return 0; // returning 0 as feedback error value
         }
     }
 
-    void writeRF(bitset<5> Reg_addr, bitset<32> Wrt_reg_data) // writes data to a specified register
+    void writeRF(uint8_t Reg_addr, uint32_t Wrt_reg_data) // writes data to a specified register
     {
 
-        if (Reg_addr.to_ulong() < Registers.size()) // checking if Reg_addr param is with in the valid register range of 0-31
+        if (Reg_addr < Registers.size()) // checking if Reg_addr param is with in the valid register range of 0-31
         {
-            if (Reg_addr.to_ulong() != 0) // Checking if intended register is 0,
+            if (Reg_addr != 0) // Checking if intended register is 0,
             {
-                Registers[Reg_addr.to_ulong()] = Wrt_reg_data; // if not 0, writing data to specified register
+                Registers[Reg_addr] = Wrt_reg_data; // if not 0, writing data to specified register
             }
             else
             {
-                printf("Warming: Attempt to write to register 0."); // printing warning when attempting to write to register 0
+                SIM_EVENT(LOG_REGFILE, LOG_WARN, EV_X0_WRITE, Wrt_reg_data); // warning when attempting to write to register 0
             }
         }
         else
         {
-            printf("Error: Register address out of range."); // giving error feedback if given invalid register #
+            SIM_EVENT(LOG_REGFILE, LOG_ERROR, EV_REG_OUT_OF_RANGE, Reg_addr); // giving error feedback if given invalid register #
         }
     }
 
-    void outputRF(int cycle) // writes the state of registers to output file
+    uint32_t *data() // direct access for the interpreter fast path, which keeps x0 at 0 itself
     {
-        ofstream rfout;
-        if (cycle == 0)
-            rfout.open(outputFile, std::ios_base::trunc);
-        else
-            rfout.open(outputFile, std::ios_base::app);
-        if (rfout.is_open())
-        {
-            rfout << "State of RF after executing cycle:\t" << cycle << endl;
-            for (int j = 0; j < 32; j++)
-            {
-                rfout << Registers[j] << endl;
-            }
-        }
-        else
-            cout << "Unable to open RF output file." << endl;
-        rfout.close();
+        return Registers.data();
+    }
+
+    const array<uint32_t, 32> &registers() const // current contents, copied into trace records
+    {
+        return Registers;
+    }
+
+    void loadRegisters(const array<uint32_t, 32> &values) // architectural handoff from another core
+    {
+        Registers = values;
+        Registers[0] = 0;
     }
 
 private:
-    vector<bitset<32>> Registers;
+    array<uint32_t, 32> Registers;
 };
 
 class Core
@@ -315,699 +238,1423 @@ public:
     RegisterFile myRF;
     uint32_t cycle = 0;
     bool halted = false;
+    uint8_t trapCause = TRAP_NONE; // set when the core stopped at a trap instead of a halt
+    uint32_t trapPC = 0;
     string ioDir;
-    struct stateStruct state, nextState;
-    InsMem ext_imem;
-    DataMem ext_dmem;
+    TraceWriter trace; // writes RFResult/StateResult in the background
+    CommitRecord lastCommit;           // architectural effect of the most recently retired instruction
+    CommitStream *commitLog = nullptr; // --cosim: every retired instruction is also pushed here
+    InsMem &ext_imem; // shared between cores so the decode cache is only filled once
+    DataMem &ext_dmem; // the caller's DataMem, so its final dump reflects the run
+    CounterRegistry counters; // every named performance counter of this core and its models
+    EventLog events;          // structured diagnostics, only filled in builds with SIM_LOG_CATEGORIES set
 
     Core(string ioDir, InsMem &imem, DataMem &dmem) : myRF(ioDir), ioDir{ioDir}, ext_imem{imem}, ext_dmem{dmem} {}
 
-    virtual void step() {}
+    void traceCycle(const stateStruct &traced, int cycle) // queue this cycle's RF and state for the trace writer thread
+    {
+        trace.push(cycle, myRF.registers(), traced);
+    }
+
+    virtual void loadArchState(uint32_t PC, const RegisterFile &rf) = 0; // restart from another core's architectural state with an empty pipeline
+
+    void raiseTrap(uint8_t cause, uint32_t PC, uint32_t instruction) // the core stops in front of the instruction at PC
+    {
+        trapCause = cause;
+        trapPC = PC;
+        SIM_EVENT(LOG_PIPELINE, LOG_ERROR, EV_TRAP, PC, cause, instruction);
+        char message[96];
+        snprintf(message, sizeof(message), "%s at PC 0x%08x (instruction 0x%08x), core stopped.", trapName(cause), PC, instruction);
+        console() << message << endl;
+    }
+
+    void retire() // publish lastCommit to the co-simulation checker, if one is attached
+    {
+        if (commitLog)
+            commitLog->push(lastCommit);
+    }
+
+    void outputEvents() // <ioDir>Events.bin, decode with event_dump; nothing is written if no event was recorded
+    {
+        if (events.size() == 0)
+            return;
+        if (!events.write(ioDir + "Events.bin"))
+            console() << "Unable to open event log output file." << endl;
+    }
+
+    void outputCounters(const string &basePath, const string &coreName, uint64_t instructions) // <basePath>.json and <basePath>.csv
+    {
+        ofstream json(basePath + ".json");
+        ofstream csv(basePath + ".csv");
+        if (!json.is_open() || !csv.is_open())
+        {
+            console() << "Unable to open performance counter output files." << endl;
+            return;
+        }
+        counters.writeJson(json, coreName, cycle, instructions);
+        counters.writeCsv(csv, cycle, instructions);
+    }
+};
+
+// The single-stage and five-stage cores: one instruction per pipeline stage, in the
+// stateStruct latches that the state trace and checkpoints are written from
+class ScalarCore : public Core
+{
+public:
+    stateStruct stateBuffers[2];                // double-buffered pipeline state
+    stateStruct *state = &stateBuffers[0];      // latches as of the start of the cycle
+    stateStruct *nextState = &stateBuffers[1];  // latches being built for the next cycle
+
+    ScalarCore(string ioDir, InsMem &imem, DataMem &dmem) : Core(ioDir, imem, dmem) {}
+
+    void loadArchState(uint32_t PC, const RegisterFile &rf)
+    {
+        stateBuffers[0] = stateStruct();
+        stateBuffers[1] = stateStruct();
+        state->IF.PC = PC;
+        nextState->IF.PC = PC;
+        myRF.loadRegisters(rf.registers());
+        halted = false;
+    }
+
+    void advanceState() // end of cycle: nextState becomes state without copying either buffer
+    {
+        swap(state, nextState);
+    }
+
+    // Checkpoint hooks: each core type tags its checkpoints and lists its own performance counters
+    virtual uint8_t checkpointKind() const { return 0; }
+    virtual vector<uint64_t> saveCounters() const { return {}; }
+    virtual void restoreCounters(const vector<uint64_t> &counters) {}
+    virtual void saveMicroarch(ostream &out) const {}                 // state beyond latches and counters
+    virtual bool restoreMicroarch(istream &in) { return true; }
+
+    bool saveCheckpoint(const string &path) // full simulator state, see checkpoint.h for the layout
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out.is_open())
+        {
+            console() << "Unable to open checkpoint file " << path << " for writing." << endl;
+            return false;
+        }
+
+        out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        putU8(out, checkpointKind());
+        putU64(out, cycle);
+        putU8(out, halted);
+        putState(out, *state);
+        putState(out, *nextState);
+        for (uint32_t value : myRF.registers())
+            putU32(out, value);
+
+        vector<uint64_t> counters = saveCounters();
+        putU32(out, counters.size());
+        for (uint64_t value : counters)
+            putU64(out, value);
+        saveMicroarch(out);
+
+        ext_dmem.saveContents(out);
+        return out.good();
+    }
+
+    bool restoreCheckpoint(const string &path)
+    {
+        ifstream in(path, ios::binary);
+        char magic[sizeof(CHECKPOINT_MAGIC)];
+        if (!in.is_open() || !in.read(magic, sizeof(magic)) || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0)
+        {
+            console() << "Unable to read checkpoint file " << path << "." << endl;
+            return false;
+        }
+        if (getU8(in) != checkpointKind())
+        {
+            console() << "Checkpoint " << path << " was taken on a different core type." << endl;
+            return false;
+        }
+
+        cycle = static_cast<uint32_t>(getU64(in));
+        halted = getU8(in) != 0;
+        getState(in, *state);
+        getState(in, *nextState);
+        array<uint32_t, 32> registers;
+        for (uint32_t &value : registers)
+            value = getU32(in);
+        myRF.loadRegisters(registers);
+
+        vector<uint64_t> counters(getU32(in));
+        for (uint64_t &value : counters)
+            value = getU64(in);
+        restoreCounters(counters);
+        if (!restoreMicroarch(in))
+        {
+            console() << "Checkpoint " << path << " does not match this core's configuration." << endl;
+            return false;
+        }
 
-    virtual void printState() {}
+        if (!ext_dmem.loadContents(in))
+        {
+            console() << "Checkpoint file " << path << " is truncated." << endl;
+            return false;
+        }
+        return true;
+    }
 };
 
-class SingleStageCore : public Core
+class SingleStageCore : public ScalarCore
 {
 public:
-	SingleStageCore(string ioDir, InsMem &imem, DataMem &dmem) : Core(ioDir + "\\SS_", imem, dmem), opFilePath(ioDir + "\\StateResult_SS.txt"), perfFilePath(ioDir + "\\PerformanceMetrics_SS.txt") {} //! __________________
+	SingleStageCore(string ioDir, InsMem &imem, DataMem &dmem, TraceMode traceMode = TRACE_TEXT) : ScalarCore(joinPath(ioDir, "SS_"), imem, dmem), opFilePath(joinPath(ioDir, "StateResult_SS.txt")), perfFilePath(joinPath(ioDir, "PerformanceMetrics_SS.txt")), counterPath(joinPath(ioDir, "PerformanceMetrics_SS")) //! __________________
+	{
+		trace.open(myRF.outputFile, opFilePath, this->ioDir + "Trace.bin", TRACE_SINGLE_STAGE, traceMode);
+	}
 
 	DataMem &getDataMem()
 	{ // helper function to get the final Dmem values
 		return ext_dmem;
 	}
 
-	// Immidiate Sign Extensions
-	int32_t sign_extend_imm(int16_t imm)
-	{
-		return static_cast<int32_t>(imm); // Sign-extend 12-bit to 32-bit
-	}
-
-	int32_t sign_extend_imm_I(int32_t imm)
+	void step() // one instruction, lastCommit always describes it afterwards
 	{
-		if (imm & (1 << 11))
-		{					   // Check if the 12th bit (sign bit) is set
-			imm |= 0xFFFFF000; // Fill the upper 20 bits with 1's for sign extension
-		}
-		return imm;
+		run(1, true);
 	}
 
-	int32_t sign_extend_imm_B(int32_t imm)
+	// Functional fast path: executes up to `limit` instructions, stopping early at the halt
+	// (which counts as one instruction, as it always has) or at a trap (which does not).
+	// Returns how many were executed.
+	uint64_t run(uint64_t limit, bool recordCommits = false)
 	{
-		if (imm & (1 << 12))
-		{					   // Check if the 13th bit (sign bit) is set
-			imm |= 0xFFFFE000; // Sign-extend to 32-bits for 13-bit immediate
-		}
-		return imm;
+		recordCommits = recordCommits || commitLog != nullptr;
+		if (trace.enabled())
+			return recordCommits ? execute<true, true>(limit) : execute<true, false>(limit);
+		if (recordCommits)
+			return execute<false, true>(limit);
+		return runBlocks(limit);
 	}
 
-	int32_t sign_extend_imm_J(int32_t imm)
+	int instructionCount() const
 	{
-		// Check if the 20th bit (sign bit for 21-bit immediate) is set
-		if (imm & (1 << 20))
-		{
-			imm |= 0xFFE00000; // Fill the upper bits with 1's
-		}
-		return imm;
+		return totalInstructions;
 	}
 
-	int32_t extract_jal_imm(const bitset<32> &instruction)
-	{	// helper function to extra i-type 21 bit immediate
-		int32_t imm = 0;
+	uint8_t checkpointKind() const { return CHECKPOINT_SINGLE_STAGE; }
 
-		// Assemble the immediate value from instruction bits as described above
-		imm |= ((instruction[31] ? 1 : 0) << 20);			  // Bit 20 (sign bit)
-		imm |= ((instruction.to_ulong() >> 12) & 0xFF) << 12; // Bits 19-12
-		imm |= ((instruction[20] ? 1 : 0) << 11);			  // Bit 11
-		imm |= ((instruction.to_ulong() >> 21) & 0x3FF) << 1; // Bits 10-1
-
-		// Sign-extend to 32 bits if the sign bit is set
-		if (imm & (1 << 20))
-		{
-			imm |= 0xFFE00000; // Extend the upper bits with 1's
-		}
-
-		return imm;
+	vector<uint64_t> saveCounters() const
+	{
+		return {static_cast<uint64_t>(totalInstructions)};
 	}
 
-	void step()
+	void restoreCounters(const vector<uint64_t> &counters)
 	{
-		// Instruction Fetch (IF)
-		bitset<32> current_instruction = ext_imem.readInstr(state.IF.PC);
-		// cout << "Cycle: " << cycle << endl; 	//* debug
-
-		if (current_instruction == bitset<32>(0) || current_instruction == bitset<32>(0xFFFFFFFF) || nextState.IF.PC.to_ulong() >= MemSize)
-		{	// checking for halt conditions
-			totalInstructions++; 	// keeping track of instruction count
-			halted = true;
-			nextState.IF.nop = true;
-			nextState.IF.PC = state.IF.PC;
-			myRF.outputRF(cycle);
-			printState(nextState, cycle);
-			cycle++;
-
-			// extra cycles to confirm state
-			int extra_Cycles = 0;
-			if (halted)
-			{
-				if (extra_Cycles < 2)
-				{
-					myRF.outputRF(cycle);
-					printState(nextState, cycle);
-					cycle++;
-				}
-				return;
-			}
+		totalInstructions = counters.size() > 0 ? counters[0] : 0;
+	}
 
-			return;
-		}
-		else
+	void outputPerformanceMetrics()
+	{	// output for PerformanceMetrics
+		ofstream metricsOut(perfFilePath);
+		if (metricsOut.is_open())
 		{
-			nextState.IF.nop = false;
-		}
+			float cpi = static_cast<float>(cycle) / totalInstructions;
+			float ipc = static_cast<float>(totalInstructions) / cycle;
 
-		totalInstructions++;
+			metricsOut << "-----------------------------Single Stage Core Performance Metrics-----------------------------" << endl;
+			metricsOut << "Number of cycles taken: " << cycle << endl;
+			metricsOut << "Total Number of Instructions: " << totalInstructions << endl;
+			metricsOut << "Cycles per instruction (CPI): " << cpi << endl;
+			metricsOut << "Instructions per cycle (IPC): " << ipc << endl;
 
-		nextState.IF.PC = state.IF.PC.to_ulong() + 4;
-
-		// Decode Instruction
-		bitset<7> opcode = bitset<7>((current_instruction.to_ulong()) & 0x7F);
-		bitset<5> rs1 = bitset<5>((current_instruction >> 15).to_ulong() & 0x1F);
-		bitset<5> rs2 = bitset<5>((current_instruction >> 20).to_ulong() & 0x1F);
-		bitset<5> rd = bitset<5>((current_instruction >> 7).to_ulong() & 0x1F);
-		bitset<3> func3 = bitset<3>((current_instruction >> 12).to_ulong() & 0x07);
-		bitset<7> func7 = bitset<7>((current_instruction >> 25).to_ulong());
-
-		// Immediate Extraction
-		int32_t imm_I = sign_extend_imm_I(static_cast<int16_t>((current_instruction.to_ulong() >> 20) & 0xFFF));
-		int32_t imm_S = sign_extend_imm(static_cast<int16_t>(((current_instruction >> 20).to_ulong() & 0xFE0) |
-															 ((current_instruction >> 7).to_ulong() & 0x1F)));
-		// Correct B-Type immediate calculation
-		int32_t imm_B = ((current_instruction[31] << 12) |
-						 ((current_instruction.to_ulong() >> 25) & 0x3F) << 5 |
-						 ((current_instruction.to_ulong() >> 8) & 0xF) << 1 |
-						 ((current_instruction.to_ulong() >> 7) & 0x1) << 11);
-
-		imm_B = sign_extend_imm_B(imm_B); // Apply sign extension
-		int32_t imm_J = extract_jal_imm(current_instruction);
-
-		// extracting source registers
-		bitset<32> read_data1 = myRF.readRF(rs1);
-		bitset<32> read_data2 = myRF.readRF(rs2);
-		bitset<32> alu_result(0);
-
-		if (opcode == bitset<7>("0110011")) // R-Type Instructions
-		{
-			// cout << "R-type called" << endl;		//* debug
-			if (func3 == bitset<3>("000") && func7 == bitset<7>("0000000")) // ADD
-			{
-				// cout << "ADD called" << endl;	//* debug
-				alu_result = read_data1.to_ulong() + read_data2.to_ulong();
-			}
-			else if (func3 == bitset<3>("000") && func7 == bitset<7>("0100000")) // SUB
-			{
-				// cout << "SUB called" << endl;	//* debug
-				alu_result = read_data1.to_ulong() - read_data2.to_ulong();
-			}
-			else if (func3 == bitset<3>("100")) // XOR
-			{
-				// cout << "XOR called" << endl;	//* debug
-				alu_result = read_data1 ^ read_data2;
-			}
-			else if (func3 == bitset<3>("110")) // OR
-			{
-				// cout << "OR called" << endl;		//* debug
-				alu_result = read_data1 | read_data2;
-			}
-			else if (func3 == bitset<3>("111")) // AND
-			{
-				// cout << "AND called" << endl;	//* debug
-				alu_result = read_data1 & read_data2;
-			}
+			metricsOut.close();
+			outputCounters(counterPath, "single-stage", totalInstructions);
 		}
-
-		else if (opcode == bitset<7>("0010011")) // I-Type Instructions
+		else
 		{
-			// cout << "I-Type called" << endl;		//* debug
-			if (func3 == bitset<3>("000")) // ADDi
-			{
-				// cout << "ADDi called" << endl;	//* debug
-
-				// Convert read_data1 to signed integer
-				int32_t data1_signed = static_cast<int32_t>(read_data1.to_ulong());
-
-				// Addition
-				int32_t result = data1_signed + imm_I;
-				alu_result = bitset<32>(result); // Convert back to bitset for storing in alu_result
-			}
-			else if (func3 == bitset<3>("100")) // XORi
-			{
-				// cout << "XORi called" << endl;	//* debug
-				alu_result = read_data1.to_ulong() ^ imm_I;
-			}
-			else if (func3 == bitset<3>("110")) // ORi
-			{
-				// cout << "ORi called" << endl;	//* debug
-				alu_result = read_data1.to_ulong() | imm_I;
-			}
-			else if (func3 == bitset<3>("111")) // ANDi
-			{
-				// cout << "ANDi called" << endl;	//* debug
-				alu_result = read_data1.to_ulong() & imm_I;
-			}
+			console() << "Unable to open performance metrics output file." << endl;
 		}
+	}
 
-		else if (opcode == bitset<7>("0000011")) // LW
-		{
-			// cout << "LW called" << endl;		//* debug
-			alu_result = read_data1.to_ulong() + imm_I;
-		}
+private:
+	// Interpreter loop. Every predecoded op has its own handler label; with computed goto each
+	// handler jumps straight to the next instruction's handler, otherwise a switch does the same
+	// through one shared jump table. Traced/Commits compile the per-instruction bookkeeping out
+	// of the fast-forward path.
+	template <bool Traced, bool Commits>
+	uint64_t execute(uint64_t limit)
+	{
+		uint32_t *x = myRF.data();
+		uint32_t PC = state->IF.PC;
+		uint64_t executed = 0;
+		const MicroOp *u;
+		uint32_t value; // what the ALU and load handlers write to rd
+
+#if SS_THREADED_DISPATCH
+		static void *const handlers[OP_COUNT] = {
+			&&op_trap,
+			&&op_add, &&op_sub, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_xor, &&op_alu_r, &&op_alu_r, &&op_or, &&op_and,
+			&&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r,
+			&&op_addi, &&op_alu_i, &&op_alu_i, &&op_xori, &&op_ori, &&op_andi, &&op_alu_i, &&op_alu_i, &&op_alu_i,
+			&&op_load, &&op_load, &&op_lw, &&op_load, &&op_load,
+			&&op_store, &&op_store, &&op_sw,
+			&&op_beq, &&op_bne, &&op_branch, &&op_branch, &&op_branch, &&op_branch,
+			&&op_jal, &&op_jalr, &&op_lui, &&op_auipc,
+			&&op_nop, &&op_trap, &&op_trap, &&op_halt};
+#define SS_DISPATCH() goto *handlers[u->op]
+#else
+#define SS_DISPATCH()                  \
+	switch (u->op)                     \
+	{                                  \
+	case OP_ADD: goto op_add;          \
+	case OP_SUB: goto op_sub;          \
+	case OP_SLL:                       \
+	case OP_SLT:                       \
+	case OP_SLTU:                      \
+	case OP_SRL:                       \
+	case OP_SRA: goto op_alu_r;        \
+	case OP_XOR: goto op_xor;          \
+	case OP_OR: goto op_or;            \
+	case OP_AND: goto op_and;          \
+	case OP_MUL:                       \
+	case OP_MULH:                      \
+	case OP_MULHSU:                    \
+	case OP_MULHU:                     \
+	case OP_DIV:                       \
+	case OP_DIVU:                      \
+	case OP_REM:                       \
+	case OP_REMU: goto op_alu_r;       \
+	case OP_ADDI: goto op_addi;        \
+	case OP_SLTI:                      \
+	case OP_SLTIU:                     \
+	case OP_SLLI:                      \
+	case OP_SRLI:                      \
+	case OP_SRAI: goto op_alu_i;       \
+	case OP_XORI: goto op_xori;        \
+	case OP_ORI: goto op_ori;          \
+	case OP_ANDI: goto op_andi;        \
+	case OP_LB:                        \
+	case OP_LH:                        \
+	case OP_LBU:                       \
+	case OP_LHU: goto op_load;         \
+	case OP_LW: goto op_lw;            \
+	case OP_SB:                        \
+	case OP_SH: goto op_store;         \
+	case OP_SW: goto op_sw;            \
+	case OP_BEQ: goto op_beq;          \
+	case OP_BNE: goto op_bne;          \
+	case OP_BLT:                       \
+	case OP_BGE:                       \
+	case OP_BLTU:                      \
+	case OP_BGEU: goto op_branch;      \
+	case OP_JAL: goto op_jal;          \
+	case OP_JALR: goto op_jalr;        \
+	case OP_LUI: goto op_lui;          \
+	case OP_AUIPC: goto op_auipc;      \
+	case OP_FENCE: goto op_nop;        \
+	case OP_HALT: goto op_halt;        \
+	default: goto op_trap;             \
+	}
+#endif
 
-		else if (opcode == bitset<7>("0100011")) // SW
+	next:
+		if (executed == limit)
+			goto done;
+		u = &ext_imem.decodeAt(PC); // predecoded on first fetch
+		if (Commits)
 		{
-			// cout << "SW called" << endl;		//* debug
-			alu_result = read_data1.to_ulong() + imm_S;
-			ext_dmem.writeDataMem(bitset<32>(alu_result), read_data2);
+			lastCommit = CommitRecord();
+			lastCommit.PC = PC;
+			lastCommit.cycle = cycle;
 		}
-		else if (opcode == bitset<7>("1100011")) // BEQ & BNE
+		SS_DISPATCH();
+
+	op_add:
+		value = x[u->rs1] + x[u->rs2];
+		goto write_rd;
+	op_sub:
+		value = x[u->rs1] - x[u->rs2];
+		goto write_rd;
+	op_xor:
+		value = x[u->rs1] ^ x[u->rs2];
+		goto write_rd;
+	op_or:
+		value = x[u->rs1] | x[u->rs2];
+		goto write_rd;
+	op_and:
+		value = x[u->rs1] & x[u->rs2];
+		goto write_rd;
+	op_addi:
+		value = x[u->rs1] + u->imm;
+		goto write_rd;
+	op_xori:
+		value = x[u->rs1] ^ u->imm;
+		goto write_rd;
+	op_ori:
+		value = x[u->rs1] | u->imm;
+		goto write_rd;
+	op_andi:
+		value = x[u->rs1] & u->imm;
+		goto write_rd;
+	op_alu_r: // the less common R-type ops and RV32M share one handler
+		value = aluResult(u->op, x[u->rs1], x[u->rs2]);
+		goto write_rd;
+	op_alu_i:
+		value = aluResult(u->op, x[u->rs1], u->imm);
+		goto write_rd;
+	op_lui:
+		value = u->imm;
+		goto write_rd;
+	op_auipc:
+		value = PC + u->imm;
+		goto write_rd;
+	op_lw:
+		value = ext_dmem.readDataMem(x[u->rs1] + u->imm);
+		goto write_rd;
+	op_load:
+		value = loadResult(u->op, ext_dmem.readDataMem(x[u->rs1] + u->imm, accessBytes(u->op)));
+		goto write_rd;
+	op_sw:
+		ext_dmem.writeDataMem(x[u->rs1] + u->imm, x[u->rs2]);
+		goto stored;
+	op_store:
+		ext_dmem.writeDataMem(x[u->rs1] + u->imm, x[u->rs2], accessBytes(u->op));
+	stored:
+		if (Commits)
 		{
-			// cout << "BEQ or BNE called" << endl;		//* debug
-			bool branch_taken = false;
-
-			if ((func3 == bitset<3>("000") && read_data1 == read_data2) || // BEQ
-				(func3 == bitset<3>("001") && read_data1 != read_data2))   // BNE
-			{
-				branch_taken = true;
-				int32_t branch_target = state.IF.PC.to_ulong() + imm_B; // Calculating branch target
-
-				// Set the new PC to target if branching
-				nextState.IF.PC = bitset<32>(branch_target);
-				// cout << "Branch taken, PC updated to: " << branch_target << ", imm_B: " << imm_B << endl;	//* debug
-			}
-
-			if (!branch_taken)
-			{
-				// No branch taken; proceed to next instruction
-				nextState.IF.PC = bitset<32>(state.IF.PC.to_ulong() + 4);
-				// cout << "Branch not taken, PC updated to: " << nextState.IF.PC.to_ulong() << endl;	//* debug
-			}
+			lastCommit.wrt_mem = true;
+			lastCommit.Store_addr = x[u->rs1] + u->imm;
+			lastCommit.Store_data = x[u->rs2];
 		}
-
-		else if (opcode == bitset<7>("1101111")) // JAL
+		goto advance;
+	op_beq:
+		PC = (x[u->rs1] == x[u->rs2]) ? PC + u->imm : PC + 4;
+		goto retire_op;
+	op_bne:
+		PC = (x[u->rs1] != x[u->rs2]) ? PC + u->imm : PC + 4;
+		goto retire_op;
+	op_branch:
+		PC = branchTaken(u->op, x[u->rs1], x[u->rs2]) ? PC + u->imm : PC + 4;
+		goto retire_op;
+	op_jal:
+		value = PC + 4; // link address
+		PC += u->imm;
+		goto link;
+	op_jalr:
+		value = PC + 4;
+		PC = (x[u->rs1] + u->imm) & ~1u; // rs1 is read before rd is written, they may be the same
+	link:
+		if (u->rd != 0)
 		{
-			// cout << "JAL called" << endl;	//* debug
-
-			// Calculate the link address
-			int32_t link_address = state.IF.PC.to_ulong() + 4;
-
-			// Calculate the target jump
-			int32_t jump_target = static_cast<int32_t>(state.IF.PC.to_ulong()) + imm_J;
-
-			// Write the link address to rd register
-			if (rd.to_ulong() != 0)
+			x[u->rd] = value;
+			if (Commits)
 			{
-				myRF.writeRF(rd, bitset<32>(link_address)); // Store PC + 4 in the destination register
-				// cout << "JAL link address (PC + 4) written to rd: " << link_address << endl;		//* debug
+				lastCommit.wrt_enable = true;
+				lastCommit.rd = u->rd;
+				lastCommit.Wrt_data = value;
 			}
-
-			// Update PC to jump
-			nextState.IF.PC = bitset<32>(jump_target);
-			// cout << "JAL executed, New PC set to: " << nextState.IF.PC.to_ulong() << ", imm_J: " << imm_J << endl;	//* debug
-		}
-
-		if (nextState.IF.PC.to_ulong() >= MemSize || nextState.IF.PC.to_ulong() < 0)
-		{
-			// cout << "Error: PC out of range - accessing IMem at address: " << nextState.IF.PC.to_ulong() << endl;	//* debug
-			halted = true;
-			return;
-		}
-
-		bitset<32> mem_data(0);
-
-		if (opcode == bitset<7>("0000011")) // SS_RFResult
-		{
-			mem_data = ext_dmem.readDataMem(alu_result);
 		}
+		goto retire_op;
+	op_nop:
+		goto advance;
+	op_trap:
+		// no trap handler to enter: the core stops here and the instruction does not retire
+		raiseTrap(trapCauseOf(u->op), PC, u->raw);
+		halted = true;
+		goto done;
+	op_halt:
+		// halt: IF goes idle and the final state is recorded for two more cycles
+		totalInstructions++;
+		executed++;
+		halted = true;
+		nextState->IF.PC = PC;
+		nextState->IF.nop = true;
+		traceCycle(*nextState, cycle);
+		cycle++;
+		traceCycle(*nextState, cycle);
+		cycle++;
+		goto done;
 
-		if (opcode == bitset<7>("0110011") || opcode == bitset<7>("0010011"))
+	write_rd:
+		if (u->rd != 0)
+			x[u->rd] = value;
+		else
+			myRF.writeRF(0, value); // only reports the ignored write to x0
+		if (Commits)
 		{
-			myRF.writeRF(rd, alu_result);
+			lastCommit.Wrt_data = value;
+			lastCommit.wrt_enable = u->rd != 0;
+			lastCommit.rd = u->rd;
 		}
-		else if (opcode == bitset<7>("0000011"))
+	advance:
+		PC += 4;
+	retire_op:
+		totalInstructions++;
+		executed++;
+		if (Commits)
+			retire();
+		if (Traced)
 		{
-			myRF.writeRF(rd, mem_data);
+			state->IF.PC = PC;
+			state->IF.nop = false;
+			traceCycle(*state, cycle);
 		}
-
-		myRF.outputRF(cycle);
-		printState(nextState, cycle);
-
-		state = nextState;
 		cycle++;
-	}
+		goto next;
 
-	void printState(stateStruct state, int cycle)
-	{	// output for StateResult
-		ofstream printstate(opFilePath, cycle == 0 ? std::ios_base::trunc : std::ios_base::app);
-		if (printstate.is_open())
-		{
-			printstate << "----------------------------------------------------------------------\n";
-			printstate << "State after executing cycle: " << cycle << "\n";
-			printstate << "IF.PC: " << state.IF.PC.to_ulong() << "\n";
-			printstate << "IF.nop: " << (state.IF.nop ? "True" : "False") << "\n";
-			printstate << "----------------------------------------------------------------------\n";
-		}
-		printstate.close();
+	done:
+		state->IF.PC = PC;
+		state->IF.nop = false;
+		return executed;
+#undef SS_DISPATCH
 	}
 
-	void outputPerformanceMetrics()
-	{	// output for PerformanceMetrics
-		ofstream metricsOut(perfFilePath);
-		if (metricsOut.is_open())
-		{
-			float cpi = static_cast<float>(cycle) / totalInstructions;
-			float ipc = static_cast<float>(totalInstructions) / cycle;
-
-			metricsOut << "-----------------------------Single Stage Core Performance Metrics-----------------------------" << endl;
-			metricsOut << "Number of cycles taken: " << cycle << endl;
-			metricsOut << "Total Number of Instructions: " << totalInstructions << endl;
-			metricsOut << "Cycles per instruction (CPI): " << cpi << endl;
-			metricsOut << "Instructions per cycle (IPC): " << ipc << endl;
-
-			metricsOut.close();
-		}
+	// Block engine for the untraced path: whole translated blocks run back to back and
+	// follow their chained successors, so the instruction limit, the halt and the cache
+	// lookup are only checked once per block. Whatever does not fit in a whole block
+	// (the tail of the limit, the halt, a trapping instruction) finishes on the
+	// per-instruction engine.
+	uint64_t runBlocks(uint64_t limit)
+	{
+		uint32_t *x = myRF.data();
+		uint32_t PC = state->IF.PC;
+		uint64_t executed = 0;
+		TranslatedBlock *block = ext_imem.blockAt(PC);
+		const BlockOp *op;
+		uint32_t value;
+		int taken; // successor slot chosen by the block's last instruction
+		TranslatedBlock *successor;
+
+#if SS_THREADED_DISPATCH
+		static void *const handlers[OP_COUNT + 1] = {
+			&&op_nop,
+			&&op_add, &&op_sub, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_xor, &&op_alu_r, &&op_alu_r, &&op_or, &&op_and,
+			&&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r, &&op_alu_r,
+			&&op_addi, &&op_alu_i, &&op_alu_i, &&op_xori, &&op_ori, &&op_andi, &&op_alu_i, &&op_alu_i, &&op_alu_i,
+			&&op_load, &&op_load, &&op_lw, &&op_load, &&op_load,
+			&&op_store, &&op_store, &&op_sw,
+			&&op_beq, &&op_bne, &&op_branch, &&op_branch, &&op_branch, &&op_branch,
+			&&op_jal, &&op_jalr, &&op_lui, &&op_lui,
+			&&op_nop, &&op_nop, &&op_nop, &&op_nop, &&block_fallthrough};
+#define SS_BLOCK_DISPATCH() goto *handlers[op->op]
+#else
+#define SS_BLOCK_DISPATCH()                       \
+	switch (op->op)                               \
+	{                                             \
+	case OP_ADD: goto op_add;                     \
+	case OP_SUB: goto op_sub;                     \
+	case OP_SLL:                                  \
+	case OP_SLT:                                  \
+	case OP_SLTU:                                 \
+	case OP_SRL:                                  \
+	case OP_SRA: goto op_alu_r;                   \
+	case OP_XOR: goto op_xor;                     \
+	case OP_OR: goto op_or;                       \
+	case OP_AND: goto op_and;                     \
+	case OP_MUL:                                  \
+	case OP_MULH:                                 \
+	case OP_MULHSU:                               \
+	case OP_MULHU:                                \
+	case OP_DIV:                                  \
+	case OP_DIVU:                                 \
+	case OP_REM:                                  \
+	case OP_REMU: goto op_alu_r;                  \
+	case OP_ADDI: goto op_addi;                   \
+	case OP_SLTI:                                 \
+	case OP_SLTIU:                                \
+	case OP_SLLI:                                 \
+	case OP_SRLI:                                 \
+	case OP_SRAI: goto op_alu_i;                  \
+	case OP_XORI: goto op_xori;                   \
+	case OP_ORI: goto op_ori;                     \
+	case OP_ANDI: goto op_andi;                   \
+	case OP_LB:                                   \
+	case OP_LH:                                   \
+	case OP_LBU:                                  \
+	case OP_LHU: goto op_load;                    \
+	case OP_LW: goto op_lw;                       \
+	case OP_SB:                                   \
+	case OP_SH: goto op_store;                    \
+	case OP_SW: goto op_sw;                       \
+	case OP_BEQ: goto op_beq;                     \
+	case OP_BNE: goto op_bne;                     \
+	case OP_BLT:                                  \
+	case OP_BGE:                                  \
+	case OP_BLTU:                                 \
+	case OP_BGEU: goto op_branch;                 \
+	case OP_JAL: goto op_jal;                     \
+	case OP_JALR: goto op_jalr;                   \
+	case OP_LUI:                                  \
+	case OP_AUIPC: goto op_lui;                   \
+	case BLOCK_FALLTHROUGH: goto block_fallthrough; \
+	default: goto op_nop;                         \
+	}
+#endif
+
+	next_block:
+		if (block->count == 0 || block->count > limit - executed)
+			goto done;
+		op = block->ops.data();
+		SS_BLOCK_DISPATCH();
+
+	op_add:
+		value = x[op->rs1] + x[op->rs2];
+		goto write_rd;
+	op_sub:
+		value = x[op->rs1] - x[op->rs2];
+		goto write_rd;
+	op_xor:
+		value = x[op->rs1] ^ x[op->rs2];
+		goto write_rd;
+	op_or:
+		value = x[op->rs1] | x[op->rs2];
+		goto write_rd;
+	op_and:
+		value = x[op->rs1] & x[op->rs2];
+		goto write_rd;
+	op_addi:
+		value = x[op->rs1] + op->imm;
+		goto write_rd;
+	op_xori:
+		value = x[op->rs1] ^ op->imm;
+		goto write_rd;
+	op_ori:
+		value = x[op->rs1] | op->imm;
+		goto write_rd;
+	op_andi:
+		value = x[op->rs1] & op->imm;
+		goto write_rd;
+	op_alu_r:
+		value = aluResult(op->op, x[op->rs1], x[op->rs2]);
+		goto write_rd;
+	op_alu_i:
+		value = aluResult(op->op, x[op->rs1], op->imm);
+		goto write_rd;
+	op_lui: // AUIPC too, translation folded its PC into the immediate
+		value = op->imm;
+		goto write_rd;
+	op_lw:
+		value = ext_dmem.readDataMem(x[op->rs1] + op->imm);
+		goto write_rd;
+	op_load:
+		value = loadResult(op->op, ext_dmem.readDataMem(x[op->rs1] + op->imm, accessBytes(op->op)));
+		goto write_rd;
+	op_sw:
+		ext_dmem.writeDataMem(x[op->rs1] + op->imm, x[op->rs2]);
+		op++;
+		SS_BLOCK_DISPATCH();
+	op_store:
+		ext_dmem.writeDataMem(x[op->rs1] + op->imm, x[op->rs2], accessBytes(op->op));
+		op++;
+		SS_BLOCK_DISPATCH();
+	op_nop:
+		op++;
+		SS_BLOCK_DISPATCH();
+	write_rd:
+		if (op->rd != 0)
+			x[op->rd] = value;
 		else
-		{
-			cout << "Unable to open performance metrics output file." << endl;
-		}
+			myRF.writeRF(0, value); // only reports the ignored write to x0
+		op++;
+		SS_BLOCK_DISPATCH();
+
+	op_beq:
+		taken = x[op->rs1] == x[op->rs2];
+		PC = taken ? block->endPC + op->imm : block->endPC + 4;
+		goto chain;
+	op_bne:
+		taken = x[op->rs1] != x[op->rs2];
+		PC = taken ? block->endPC + op->imm : block->endPC + 4;
+		goto chain;
+	op_branch:
+		taken = branchTaken(op->op, x[op->rs1], x[op->rs2]);
+		PC = taken ? block->endPC + op->imm : block->endPC + 4;
+		goto chain;
+	op_jal:
+		if (op->rd != 0)
+			x[op->rd] = block->endPC + 4; // link address
+		taken = 1;
+		PC = block->endPC + op->imm;
+		goto chain;
+	op_jalr:
+		// the target depends on rs1, so this successor is looked up every time instead of chained
+		PC = (x[op->rs1] + op->imm) & ~1u;
+		if (op->rd != 0)
+			x[op->rd] = block->endPC + 4;
+		successor = ext_imem.blockAt(PC);
+		goto retire_block;
+	block_fallthrough:
+		taken = 0;
+		PC = block->endPC + 4;
+
+	chain:
+		if (!block->next[taken])
+			block->next[taken] = ext_imem.blockAt(PC);
+		successor = block->next[taken];
+	retire_block:
+		executed += block->count;
+		totalInstructions += block->count;
+		cycle += block->count;
+		block = successor;
+		goto next_block;
+
+	done:
+		state->IF.PC = PC;
+		return executed + execute<false, false>(limit - executed);
+#undef SS_BLOCK_DISPATCH
 	}
 
-private:
 	string opFilePath;
 	string perfFilePath;
+	string counterPath; // .json/.csv counter dumps
 	int totalInstructions = 0;
 };
 
-class FiveStageCore : public Core
+// Compile-time configuration of FiveStageCore::stepAs. Settings that are fixed for a whole
+// run become template parameters, so their tests disappear from the per-cycle code.
+template <bool TraceOn, bool ForwardingOn, typename PredictorType, bool CachesOn>
+struct FiveStageConfig
+{
+    static constexpr bool trace = TraceOn;           // per-cycle RF/state trace
+    static constexpr bool forwarding = ForwardingOn; // EX/MEM and MEM/WB bypasses into EX
+    using Predictor = PredictorType;                 // a final predictor class, or BranchPredictor for virtual calls
+    static constexpr bool caches = CachesOn;         // memory model: false = every access takes one cycle
+};
+
+template <typename Visit>
+void withFlag(bool value, Visit visit) // visit(true_type()) or visit(false_type())
+{
+    if (value)
+        visit(true_type());
+    else
+        visit(false_type());
+}
+
+class FiveStageCore : public ScalarCore
 {
 public:
-    FiveStageCore(string ioDir, InsMem &imem, DataMem &dmem) : Core(ioDir + "\\FS_", imem, dmem), opFilePath(ioDir + "\\StateResult_FS.txt"), perfFilePath(ioDir + "\\PerformanceMetrics_SS.txt") {} //! __________________
+    // name prefixes the output files, "FS0", "FS1", ... when several cores share ioDir
+    FiveStageCore(string ioDir, InsMem &imem, DataMem &dmem, TraceMode traceMode = TRACE_TEXT, const string &name = "FS") : ScalarCore(joinPath(ioDir, name + "_"), imem, dmem), opFilePath(joinPath(ioDir, "StateResult_" + name + ".txt")), perfFilePath(joinPath(ioDir, "PerformanceMetrics_" + name + ".txt")), counterPath(joinPath(ioDir, "PerformanceMetrics_" + name)) //! __________________
+    {
+        trace.open(myRF.outputFile, opFilePath, this->ioDir + "Trace.bin", TRACE_FIVE_STAGE, traceMode);
+
+        counters.add("stall.load_use", loadUseStalls, "cycles ID waited for a load in EX");
+        counters.add("stall.raw", rawStalls, "cycles ID waited for any other result, forwarding off");
+        counters.add("stall.fetch", fetchStallCycles, "cycles IF waited for L1I");
+        counters.add("stall.memory", memStallCycles, "cycles the pipeline waited for L1D");
+        counters.add("stall.flush", flushCycles, "fetch slots squashed by mispredictions");
+        counters.add("bubble.IF", bubbles[0], "cycles the IF latch held no instruction");
+        counters.add("bubble.ID", bubbles[1], "cycles the IF/ID latch held a bubble");
+        counters.add("bubble.EX", bubbles[2], "cycles the ID/EX latch held a bubble");
+        counters.add("bubble.MEM", bubbles[3], "cycles the EX/MEM latch held a bubble");
+        counters.add("bubble.WB", bubbles[4], "cycles the MEM/WB latch held a bubble");
+        counters.add("mix.rtype", mixRType, "register-register ALU instructions executed");
+        counters.add("mix.itype", mixIType, "register-immediate ALU instructions executed");
+        counters.add("mix.load", mixLoads, "loads executed");
+        counters.add("mix.store", mixStores, "stores executed");
+        counters.add("mix.branch", branches, "conditional branches executed");
+        counters.add("mix.jal", jumps, "jumps executed");
+        counters.add("branch.taken", takenBranches, "conditional branches taken");
+        counters.add("branch.mispredicted", branchMispredicts, "conditional branches with a wrong predicted next PC");
+        counters.add("jump.mispredicted", jumpMispredicts, "jumps fetched without the right BTB target");
+        counters.add("forward.EX_MEM", forwardsFromMEM, "operands taken from the EX/MEM latch");
+        counters.add("forward.MEM_WB", forwardsFromWB, "operands taken from the MEM/WB latch");
+        counters.add("mix.muldiv", mixMulDiv, "multiplications and divisions executed");
+        counters.add("stall.scoreboard", scoreboardStalls, "cycles ID waited for a multiply or divide result");
+        counters.add("stall.structural", structuralStalls, "cycles ID waited for a busy divider or multiplier");
+    }
 
-    void step()
+    void setBranchPredictor(unique_ptr<BranchPredictor> bp) // replaces the default static not-taken predictor
     {
-        if (cycle == 0)
-        {
-            state.EX.nop = true;
-            state.MEM.nop = true;
-            state.WB.nop = true;
+        predictor = move(bp);
+    }
 
-            nextState.EX.nop = true;
-            nextState.MEM.nop = true;
-            nextState.WB.nop = true;
-        }
+    void enableProfiler() // call once the core is at its starting PC (after fast-forward or restore)
+    {
+        profiler.reset(new PcProfiler(state->IF.PC));
+    }
 
-        cout << "---------------- Cycle: " << cycle << " ----------------" << endl;
+    void setCaches(const CacheSetup &setup) // L1I/L1D/L2 timing in front of InsMem and DataMem, off by default
+    {
+        caches.configure(setup);
+        caches.forEachCache([this](Cache &c)
+                            {
+                                counters.add(c.cacheName() + ".hits", c.hits, c.cacheName() + " hits");
+                                counters.add(c.cacheName() + ".misses", c.misses, c.cacheName() + " misses");
+                                counters.add(c.cacheName() + ".evictions", c.evictions, c.cacheName() + " valid lines replaced");
+                                counters.add(c.cacheName() + ".writebacks", c.writebacks, c.cacheName() + " dirty lines written to the next level"); });
+    }
 
-        /* --------------------- WB stage --------------------- */
-        if (!state.WB.nop)
-        {
-            totalInstructions++;
-            if (state.WB.wrt_enable && state.WB.rd.to_ulong() != 0)
-            {
-                myRF.writeRF(state.WB.rd, state.WB.Wrt_data);
-            }
-        }
+    void joinBus(CoherenceBus &bus, AccessOrder &order, unsigned id) // --cores: the L1D (write-back) snoops and is snooped by the other cores'
+    {
+        caches.joinBus(bus);
+        accessOrder = &order;
+        coreId = id;
+        Cache &l1d = *caches.dataCache();
+        counters.add(l1d.cacheName() + ".upgrades", l1d.upgrades, "writes to Shared lines that invalidated other copies");
+        counters.add(l1d.cacheName() + ".invalidations", l1d.invalidations, "lines invalidated by other cores' writes");
+        counters.add(l1d.cacheName() + ".interventions", l1d.interventions, "Modified lines supplied to other cores");
+    }
+
+    void setIdleSkip(bool enabled) // on by default, off gives the plain cycle-by-cycle loop for comparison
+    {
+        idleSkip = enabled;
+    }
+
+    void setSkipHorizon(uint32_t horizon) // never jump past this cycle (e.g. a pending --checkpoint-at)
+    {
+        skipHorizon = horizon;
+    }
+
+    void setForwarding(bool enabled) // off: ID waits until a source's producer has left MEM
+    {
+        forwarding = enabled;
+    }
+
+    void setMulDiv(const MulDivSetup &setup) // multiplier and divider latencies, see scoreboard.h
+    {
+        mulDiv.configure(setup);
+    }
+
+    void step() // one cycle; picks the configuration on every call, run() only once
+    {
+        withConfig([this](auto config)
+                   { stepAs<decltype(config)>(); });
+    }
+
+    // Simulates until the halt, cycle `stopCycle` or a co-simulation divergence, as one loop
+    // compiled for the current configuration
+    void run(uint32_t stopCycle = UINT32_MAX)
+    {
+        withConfig([this, stopCycle](auto config)
+                   {
+                       while (!halted && cycle < stopCycle && !(commitLog && commitLog->diverged()))
+                           stepAs<decltype(config)>(); });
+    }
+
+    // Calls visit(FiveStageConfig<...>()) matching the trace mode, forwarding, predictor and
+    // caches set on this core, so each combination is compiled separately
+    template <typename Visit>
+    void withConfig(Visit visit)
+    {
+        const type_info &type = typeid(*predictor);
+        if (type == typeid(StaticNotTakenPredictor))
+            withFlags<StaticNotTakenPredictor>(visit);
+        else if (type == typeid(BimodalPredictor))
+            withFlags<BimodalPredictor>(visit);
+        else if (type == typeid(GsharePredictor))
+            withFlags<GsharePredictor>(visit);
+        else
+            withFlags<BranchPredictor>(visit); // a predictor this file does not know, called through the vtable
+    }
+
+    template <typename Predictor, typename Visit>
+    void withFlags(Visit &visit)
+    {
+        withFlag(trace.enabled(), [&](auto traced)
+                 { withFlag(forwarding, [&](auto forwarded)
+                            { withFlag(caches.present(), [&](auto cached)
+                                       { visit(FiveStageConfig<decltype(traced)::value, decltype(forwarded)::value, Predictor, decltype(cached)::value>()); }); }); });
+    }
+
+    template <typename Config>
+    void stepAs()
+    {
+        SIM_EVENT_SCOPE(events, cycle);
+
+        if constexpr (Config::caches) // without caches nothing ever waits on memory
+        {
+            if (idleSkip)
+            {
+                uint32_t idle = quiescentCycles();
+                if (idle > 0)
+                {
+                    skipIdle<Config>(idle);
+                    return;
+                }
+            }
+        }
+
+        SIM_EVENT(LOG_PIPELINE, LOG_DEBUG, EV_CYCLE, cycle);
+
+        // Every stage writes its whole output latch (or carries it over as a bubble),
+        // so the buffers can simply be swapped at the end of the cycle.
+
+        /* --------------------- WB stage --------------------- */
+        if (!state->WB.nop)
+        {
+            totalInstructions++;
+            if (state->WB.wrt_enable && state->WB.rd != 0)
+            {
+                myRF.writeRF(state->WB.rd, state->WB.Wrt_data);
+            }
+
+            lastCommit.PC = state->WB.PC;
+            lastCommit.cycle = cycle;
+            lastCommit.rd = state->WB.rd;
+            lastCommit.wrt_enable = state->WB.wrt_enable && state->WB.rd != 0;
+            lastCommit.Wrt_data = state->WB.Wrt_data;
+            lastCommit.wrt_mem = state->WB.wrt_mem;
+            lastCommit.Store_addr = state->WB.Store_addr;
+            lastCommit.Store_data = state->WB.Store_data;
+            retire();
+
+            if (profiler)
+            {
+                profiler->retire(state->WB.PC);
+                const MicroOp &uop = ext_imem.decodeAt(state->WB.PC);
+                if (uop.op == OP_JAL && uop.rd != 0) // linking jump, a call
+                    profiler->call(state->WB.PC, state->WB.PC + uop.imm);
+                else if (uop.op == OP_JALR && uop.rd != 0) // indirect call, its target retires next
+                    profiler->indirectCall(state->WB.PC);
+            }
+        }
 
         /* --------------------- MEM stage --------------------- */
-        if (!state.MEM.nop)
+        WBStruct &wbNext = nextState->WB;
+        if (Config::caches && !state->MEM.nop && (state->MEM.rd_mem || state->MEM.wrt_mem))
+        {
+            if (!memPending) // first cycle in MEM, ask L1D how long the access takes
+            {
+                if (accessOrder)
+                    accessOrder->waitTurn(coreId, cycle);
+                memWait = caches.data(state->MEM.ALUresult, state->MEM.wrt_mem, cycle) - 1;
+                memPending = true;
+                if (profiler)
+                    profiler->memoryAccess(state->MEM.PC);
+            }
+            if (memWait > 0)
+            {
+                memWait--;
+                memStallCycles++;
+                if (profiler)
+                    profiler->stall(state->MEM.PC);
+                holdForMemory<Config>();
+                return;
+            }
+            memPending = false;
+        }
+
+        if (!state->MEM.nop)
         {
-            if (state.MEM.rd_mem)
+            const MEMStruct &mem = state->MEM;
+            if (accessOrder && (mem.rd_mem || mem.wrt_mem))
+                accessOrder->waitTurn(coreId, cycle);
+            if (mem.rd_mem)
             {
-                nextState.WB.Wrt_data = ext_dmem.readDataMem(state.MEM.ALUresult);
+                uint8_t op = ext_imem.decodeAt(mem.PC).op; // size and signedness of the access
+                wbNext.Wrt_data = loadResult(op, ext_dmem.readDataMem(mem.ALUresult, accessBytes(op)));
             }
-            else if (state.MEM.wrt_mem)
+            else if (mem.wrt_mem)
             {
-                ext_dmem.writeDataMem(state.MEM.ALUresult, state.MEM.Store_data);
+                ext_dmem.writeDataMem(mem.ALUresult, mem.Store_data, accessBytes(ext_imem.decodeAt(mem.PC).op));
+                wbNext.Wrt_data = state->WB.Wrt_data; // stores have nothing to write back
             }
             else
             {
-                nextState.WB.Wrt_data = state.MEM.ALUresult;
+                wbNext.Wrt_data = mem.ALUresult;
             }
 
-            nextState.WB.rd = state.MEM.rd;
-            nextState.WB.wrt_enable = state.MEM.wrt_enable;
-            nextState.WB.nop = false;
+            wbNext.PC = mem.PC;
+            wbNext.Store_addr = mem.ALUresult;
+            wbNext.Store_data = mem.Store_data;
+            wbNext.rs1 = mem.rs1;
+            wbNext.rs2 = mem.rs2;
+            wbNext.rd = mem.rd;
+            wbNext.wrt_mem = mem.wrt_mem;
+            wbNext.wrt_enable = mem.wrt_enable;
+            wbNext.nop = false;
         }
         else
         {
-            nextState.WB.nop = true;
+            wbNext = state->WB;
+            wbNext.nop = true;
         }
 
-        // /* --------------------- EX stage --------------------- */
-        if (!state.EX.nop)
+        /* --------------------- EX stage --------------------- */
+        MEMStruct &memNext = nextState->MEM;
+        bool redirect = false;   // EX found a mispredicted branch or jump
+        uint32_t redirectPC = 0; // where fetch has to continue instead
+        bool trap = false;       // EX holds an illegal instruction, ECALL or EBREAK
+        if (!state->EX.nop)
         {
+            const EXStruct &ex = state->EX;
+
+            // Operands as read in ID, replaced by newer results still in the pipeline
+            uint32_t operand1 = Config::forwarding ? forwardOperand(ex.rs1, ex.Read_data1) : ex.Read_data1;
+            uint32_t operand2 = Config::forwarding ? forwardOperand(ex.rs2, ex.Read_data2) : ex.Read_data2;
+
             // Propagate the current instruction to the MEM stage
-            nextState.MEM.ALUresult = bitset<32>(0);
-            nextState.MEM.Store_data = state.EX.Read_data2;
-            nextState.MEM.rd = state.EX.rd;
-            nextState.MEM.rd_mem = state.EX.rd_mem;
-            nextState.MEM.wrt_mem = state.EX.wrt_mem;
-            nextState.MEM.wrt_enable = state.EX.wrt_enable;
-
-            // Process instruction types
-            if (state.EX.is_I_type)
+            memNext.PC = ex.PC;
+            memNext.Store_data = operand2;
+            memNext.rs1 = ex.rs1;
+            memNext.rs2 = ex.rs2;
+            memNext.rd = ex.rd;
+            memNext.rd_mem = ex.rd_mem;
+            memNext.wrt_mem = ex.wrt_mem;
+            memNext.wrt_enable = ex.wrt_enable;
+
+            const MicroOp &uop = ext_imem.decodeAt(ex.PC);
+            switch (uop.opClass)
             {
-                nextState.MEM.ALUresult = handleIType(state.EX.rs1, state.EX.func3, state.EX.Imm_I, myRF);
-            }
-            else if (state.EX.rd_mem)
+            case OPC_LOAD:
+                mixLoads++;
+                memNext.ALUresult = handleLoad(operand1, ex.Imm);
+                break;
+            case OPC_STORE:
             {
-                nextState.MEM.ALUresult = handleLoad(state.EX.rs1, state.EX.Imm_I, myRF);
+                mixStores++;
+                auto storeResult = handleStore(operand1, operand2, ex.Imm);
+                memNext.ALUresult = storeResult.first;
+                memNext.Store_data = storeResult.second;
+                break;
             }
-            else if (state.EX.wrt_mem)
+            case OPC_ITYPE:
+                mixIType++;
+                memNext.ALUresult = aluResult(uop.op, operand1, ex.Imm);
+                break;
+            case OPC_LUI:
+                mixIType++;
+                memNext.ALUresult = ex.Imm;
+                break;
+            case OPC_AUIPC:
+                mixIType++;
+                memNext.ALUresult = ex.PC + ex.Imm;
+                break;
+            case OPC_BRANCH: // resolved here against the prediction made in IF
             {
-                auto storeResult = handleStore(state.EX.rs1, state.EX.rs2, state.EX.Imm_S, myRF);
-                nextState.MEM.ALUresult = storeResult.first;
-                nextState.MEM.Store_data = storeResult.second;
+                uint32_t actualPC = handleBranch(uop.op, operand1, operand2, ex.Imm, ex.PC);
+                bool taken = actualPC != ex.PC + 4;
+                predictorAs<Config>().update(ex.PC, taken);
+                if (taken)
+                {
+                    btb.update(ex.PC, actualPC, true);
+                    takenBranches++;
+                }
+                branches++;
+                if (actualPC != ex.Next_PC)
+                {
+                    branchMispredicts++;
+                    redirect = true;
+                    redirectPC = actualPC;
+                }
+                break;
             }
-            else
+            case OPC_JAL:
+            case OPC_JALR: // a JALR's BTB entry is its last target
             {
-                nextState.MEM.ALUresult = handleRType(state.EX.rd, state.EX.rs1, state.EX.rs2, state.EX.func3, state.EX.func7, myRF);
+                uint32_t targetPC = handleJump(ex.rd, uop.opClass == OPC_JAL ? ex.PC + ex.Imm : (operand1 + ex.Imm) & ~1u, ex.PC);
+                memNext.ALUresult = ex.PC + 4; // link address
+                btb.update(ex.PC, targetPC, false);
+                jumps++;
+                if (targetPC != ex.Next_PC)
+                {
+                    jumpMispredicts++;
+                    redirect = true;
+                    redirectPC = targetPC;
+                }
+                break;
+            }
+            case OPC_MULDIV: // the value goes down the pipe now, the scoreboard holds its readers back
+                mixMulDiv++;
+                memNext.ALUresult = aluResult(uop.op, operand1, operand2);
+                scoreboard.reserve(ex.rd, mulDiv.unitFor(uop.op).start(cycle));
+                break;
+            case OPC_FENCE:
+                break;
+            case OPC_ILLEGAL:
+            case OPC_SYSTEM:
+                // Everything older has left EX, so the trap is precise: the instruction does
+                // not retire, and whatever was fetched behind it is squashed below
+                raiseTrap(trapCauseOf(uop.op), ex.PC, uop.raw);
+                trap = true;
+                break;
+            default:
+                mixRType++;
+                memNext.ALUresult = aluResult(uop.op, operand1, operand2);
+                break;
             }
 
-            nextState.MEM.nop = false;
+            memNext.nop = trap;
         }
         else
         {
-            nextState.MEM.nop = true;
+            memNext = state->MEM;
+            memNext.nop = true;
         }
 
         /* --------------------- ID stage --------------------- */
 
-        int stallCounter = 0;
+        bool stall = false;
+        EXStruct &exNext = nextState->EX;
 
-        if (!state.ID.nop)
+        if (!state->ID.nop)
         {
-            bitset<32> instruction = state.ID.Instr;
-            InstructionFields fields = checkInstr(instruction);
-
-            bool hazard = (state.EX.rd.to_ulong() != 0 &&
-                           (state.EX.rd == fields.rs1 || state.EX.rd == fields.rs2)) &&
-                          state.EX.wrt_enable;
+            const MicroOp &uop = ext_imem.decodeAt(state->ID.PC); // table lookup instead of re-decoding
+
+            // Everything else is forwarded into EX, only a load's data arrives too late for
+            // the instruction right behind it. Without forwarding every source has to be in
+            // the register file, which WB writes before ID reads it. Multiply and divide
+            // results are later still: the scoreboard knows when each one is ready, and an
+            // iterative unit takes no new operation until it has finished the last one.
+            scoreboard.advance(cycle);
+            bool waitsForResult = scoreboard.blocks(uop);
+            bool unitBusy = uop.opClass == OPC_MULDIV && !mulDiv.unitFor(uop.op).accepts(cycle + 1);
+            bool loadUse = state->EX.rd_mem && writesSource(state->EX, uop);
+            bool hazard = waitsForResult || unitBusy || (Config::forwarding ? loadUse : writesSource(state->EX, uop) || writesSource(state->MEM, uop));
 
             if (hazard)
             {
-                cout << "Hazard detected. Stalling pipeline." << endl;
-
-                cout << "Hazard detected in cycle: " << cycle << endl;
-                cout << "EX.rd: " << state.EX.rd << " Fields.rs1: " << fields.rs1 << " Fields.rs2: " << fields.rs2 << endl;
-                cout << "EX.wrt_enable: " << state.EX.wrt_enable << endl;
-
-                nextState.ID = state.ID; // Keep ID stage instruction the same
-                nextState.EX.nop = true; // Insert bubble in EX stage
-
-                // Freeze PC in IF stage
-                nextState.IF = state.IF;
-                stallCounter++;
-
-                return; 
-            }
-            else
-            {
-                // Reset stall counter once hazard clears
-                if (stallCounter > 0)
+                if (waitsForResult)
+                    scoreboardStalls++;
+                else if (unitBusy)
+                    structuralStalls++;
+                else if (loadUse)
                 {
-                    cout << "Hazard cleared after " << stallCounter << " cycles." << endl;
-                    stallCounter = 0;
+                    loadUseStalls++;
+                    SIM_EVENT(LOG_PIPELINE, LOG_INFO, EV_LOAD_USE_STALL, state->EX.rd, uop.rs1, uop.rs2);
                 }
+                else
+                    rawStalls++;
+                if (profiler)
+                    profiler->stall(state->ID.PC);
+
+                // Insert bubble in EX stage, the IF stage below holds IF and ID
+                exNext = state->EX;
+                exNext.nop = true;
+                stall = true;
             }
-
-            // Normal decoding if no hazard
-            bitset<7> opcode = bitset<7>(instruction.to_ulong() & 0x7F);
-
-            if (opcode == bitset<7>("0110011")) // R-Type
-            {
-                nextState.EX.rd = fields.rd;
-                nextState.EX.rs1 = fields.rs1;
-                nextState.EX.rs2 = fields.rs2;
-                nextState.EX.func3 = fields.funct3;
-                nextState.EX.func7 = fields.funct7;
-                nextState.EX.is_I_type = false;
-                nextState.EX.rd_mem = false;
-                nextState.EX.wrt_mem = false;
-                nextState.EX.wrt_enable = true;
-            }
-            else if (opcode == bitset<7>("0010011")) // I-Type
-            {
-                nextState.EX.rd = fields.rd;
-                nextState.EX.rs1 = fields.rs1;
-                nextState.EX.func3 = fields.funct3;
-                nextState.EX.Imm_I = fields.imm_I;
-                nextState.EX.is_I_type = true;
-                nextState.EX.rd_mem = false;
-                nextState.EX.wrt_mem = false;
-                nextState.EX.wrt_enable = true;
-            }
-            else if (opcode == bitset<7>("0000011")) // Load
-            {
-                nextState.EX.rd = fields.rd;
-                nextState.EX.rs1 = fields.rs1;
-                nextState.EX.func3 = fields.funct3;
-                nextState.EX.Imm_I = fields.imm_I;
-                nextState.EX.is_I_type = true;
-                nextState.EX.rd_mem = true;
-                nextState.EX.wrt_mem = false;
-                nextState.EX.wrt_enable = true;
-            }
-            else if (opcode == bitset<7>("0100011")) // Store
-            {
-                nextState.EX.rs1 = fields.rs1;
-                nextState.EX.rs2 = fields.rs2;
-                nextState.EX.func3 = fields.funct3;
-                nextState.EX.Imm_S = fields.imm_S;
-                nextState.EX.is_I_type = false;
-                nextState.EX.rd_mem = false;
-                nextState.EX.wrt_mem = true;
-                nextState.EX.wrt_enable = false;
-            }
-            else if (opcode == bitset<7>("1100011")) // Branch
+            else
             {
-                nextState.EX.rs1 = fields.rs1;
-                nextState.EX.rs2 = fields.rs2;
-                nextState.EX.func3 = fields.funct3;
-                nextState.EX.Imm_B = fields.imm_B;
-                nextState.EX.is_I_type = false;
-                nextState.EX.rd_mem = false;
-                nextState.EX.wrt_mem = false;
-                nextState.EX.wrt_enable = false;
+                decodeToEX(exNext, state->ID, uop, myRF); // normal decoding if no hazard
             }
-            else if (opcode == bitset<7>("1101111")) // Jump
+        }
+        else
+        {
+            exNext = state->EX;
+            exNext.nop = true;
+        }
+
+        /* --------------------- IF stage --------------------- */
+        bool fetchReady = true; // L1I has delivered the instruction at IF.PC
+        if (Config::caches && !state->IF.nop)
+        {
+            if (!fetchPending)
             {
-                nextState.EX.rd = fields.rd;
-                nextState.EX.Imm_J = fields.imm_J;
-                nextState.EX.is_I_type = false;
-                nextState.EX.rd_mem = false;
-                nextState.EX.wrt_mem = false;
-                nextState.EX.wrt_enable = true;
+                fetchWait = caches.fetch(state->IF.PC) - 1;
+                fetchPending = true;
             }
-            else
+            if (fetchWait > 0)
             {
-                nextState.EX.nop = true; 
+                fetchWait--;
+                fetchReady = false;
             }
+        }
 
-            nextState.EX.nop = false;
+        if (stall)
+        {
+            // Stall the PC and instruction fetch during hazard
+            nextState->IF = state->IF;
+            nextState->ID = state->ID;
         }
-        else
+        else if (!state->IF.nop && !fetchReady)
         {
-            nextState.EX.nop = true;
+            // Instruction cache miss: hold IF, nothing to decode next cycle
+            fetchStallCycles++;
+            if (profiler)
+                profiler->stall(state->IF.PC);
+            nextState->IF = state->IF;
+            nextState->ID = state->ID;
+            nextState->ID.nop = true;
         }
-
-        /* --------------------- IF stage --------------------- */
-        if (!state.IF.nop)
+        else if (!state->IF.nop)
         {
-            if (stallCounter > 0)
+            // Normal instruction fetch and PC increment
+            fetchPending = false;
+            uint32_t instruction = ext_imem.readInstr(state->IF.PC);
+            if (instruction == 0xFFFFFFFF) // HALT instruction
             {
-                // Stall the PC and instruction fetch during hazard
-                nextState.IF = state.IF;
+                SIM_EVENT(LOG_PIPELINE, LOG_INFO, EV_HALT, state->IF.PC);
+                nextState->IF = state->IF;
+                nextState->IF.nop = true;
+                nextState->ID = state->ID;
+                nextState->ID.nop = true;
+                halt = true;
             }
             else
             {
-                // Normal instruction fetch and PC increment
-                bitset<32> instruction = ext_imem.readInstr(state.IF.PC);
-                if (instruction.to_ulong() == 0xFFFFFFFF) // HALT instruction
-                {
-                    nextState.IF.nop = true;
-                    nextState.ID.nop = true;
-                    halt = true;
-                }
-                else
-                {
-                    nextState.ID.Instr = instruction;
-                    nextState.ID.nop = false;
-                    nextState.IF.PC = bitset<32>(state.IF.PC.to_ulong() + 4);
-                }
+                nextState->ID.PC = state->IF.PC;
+                nextState->ID.Instr = instruction;
+                nextState->ID.nop = false;
+                nextState->ID.Next_PC = predictNextPC<Config>(state->IF.PC);
+                nextState->IF.PC = nextState->ID.Next_PC;
+                nextState->IF.nop = false;
             }
         }
         else
         {
-            nextState.ID.nop = true;
+            nextState->IF = state->IF;
+            nextState->ID = state->ID;
+            nextState->ID.nop = true;
+        }
+
+        if (redirect)
+        {
+            // Mispredicted: squash the two younger instructions (in ID and IF this cycle) and
+            // refetch from the resolved PC. IF may have stopped at a halt on the wrong path.
+            SIM_EVENT(LOG_BRANCH, LOG_INFO, EV_REDIRECT, state->EX.PC, redirectPC);
+            exNext.nop = true;
+            nextState->ID.nop = true;
+            nextState->IF.PC = redirectPC;
+            nextState->IF.nop = false;
+            fetchPending = false; // a miss on the wrong path is abandoned
+            fetchWait = 0;
+            halt = false;
+            flushCycles += 2;
+        }
+        else if (trap)
+        {
+            // No handler to continue at: fetch stops and the pipeline drains as after a halt
+            exNext.nop = true;
+            nextState->ID.nop = true;
+            nextState->IF.nop = true;
+            fetchPending = false;
+            fetchWait = 0;
+            halt = true;
         }
 
         // Check if pipeline is halted
-        if (state.IF.nop && state.ID.nop && state.EX.nop && state.MEM.nop && state.WB.nop)
+        if (state->IF.nop && state->ID.nop && state->EX.nop && state->MEM.nop && state->WB.nop)
         {
             halted = true;
-            cout << "Program halted." << endl;
+            console() << "Program halted." << endl;
             return;
         }
 
         // Update pipeline state
-        myRF.outputRF(cycle);
-        printState(nextState, cycle);
-        state = nextState;
-        cycle++;
+        endCycle<Config>();
     }
 
     //! HELPERS
 
-    bool canForward(stateStruct &state)
+    // Cycles from now on in which no latch can change, because the only thing going on is a
+    // cache miss counting down: the load/store in MEM waiting with nothing left in WB, or
+    // IF waiting on L1I with the rest of the pipeline empty. 0 if this cycle does real work.
+    uint32_t quiescentCycles() const
     {
-        return (state.MEM.wrt_enable && state.MEM.rd.to_ulong() != 0) ||
-               (state.WB.wrt_enable && state.WB.rd.to_ulong() != 0);
+        uint32_t idle = 0;
+        if (memPending && memWait > 0 && state->WB.nop)
+            idle = memWait;
+        else if (fetchPending && fetchWait > 0 && !state->IF.nop && state->ID.nop && state->EX.nop && state->MEM.nop && state->WB.nop)
+            idle = fetchWait;
+
+        if (cycle < skipHorizon && idle > skipHorizon - cycle)
+            idle = skipHorizon - cycle;
+        return idle;
     }
 
-    bitset<32> handleRType(bitset<5> rd, bitset<5> rs1, bitset<5> rs2, bitset<3> func3, bitset<7> func7, RegisterFile &myRF)
+    // Same effect as `cycles` calls of step() in a quiescent interval: the latches repeat, so
+    // only the countdowns, counters and the trace advance
+    template <typename Config>
+    void skipIdle(uint32_t cycles)
     {
-        int32_t rs1_val = static_cast<int32_t>(myRF.readRF(rs1).to_ulong());
-        int32_t rs2_val = static_cast<int32_t>(myRF.readRF(rs2).to_ulong());
-        int32_t result = 0;
+        SIM_EVENT(LOG_PIPELINE, LOG_DEBUG, EV_IDLE_SKIP, cycle, cycles);
 
-        if (func3 == bitset<3>("000")) // ADD or SUB
+        uint32_t stalledPC;
+        if (memPending && memWait > 0)
+        {
+            memWait -= cycles;
+            memStallCycles += cycles;
+            stalledPC = state->MEM.PC;
+        }
+        else
         {
-            if (func7 == bitset<7>("0000000")) // ADD
-                result = rs1_val + rs2_val;
-            else if (func7 == bitset<7>("0100000")) // SUB
-                result = rs1_val - rs2_val;
+            fetchStallCycles += cycles;
+            stalledPC = state->IF.PC;
         }
-        else if (func3 == bitset<3>("100")) // XOR
-            result = rs1_val ^ rs2_val;
-        else if (func3 == bitset<3>("110")) // OR
-            result = rs1_val | rs2_val;
-        else if (func3 == bitset<3>("111")) // AND
-            result = rs1_val & rs2_val;
+        if (fetchPending) // also true while MEM waits: an instruction miss overlaps with it
+            fetchWait -= min(fetchWait, cycles);
+        if (profiler)
+            profiler->stall(stalledPC, cycles);
+
+        bubbles[0] += state->IF.nop * uint64_t(cycles);
+        bubbles[1] += state->ID.nop * uint64_t(cycles);
+        bubbles[2] += state->EX.nop * uint64_t(cycles);
+        bubbles[3] += state->MEM.nop * uint64_t(cycles);
+        bubbles[4] += state->WB.nop * uint64_t(cycles);
+
+        if constexpr (Config::trace)
+            for (uint32_t c = 0; c < cycles; c++)
+                traceCycle(*state, cycle + c);
+        cycle += cycles;
+    }
 
-        return bitset<32>(result); // Return the ALU result
+    template <typename Config>
+    void endCycle()
+    {
+        bubbles[0] += state->IF.nop;
+        bubbles[1] += state->ID.nop;
+        bubbles[2] += state->EX.nop;
+        bubbles[3] += state->MEM.nop;
+        bubbles[4] += state->WB.nop;
+        if constexpr (Config::trace)
+            traceCycle(*nextState, cycle);
+        advanceState();
+        cycle++;
     }
 
-    bitset<32> handleIType(bitset<5> rs1, bitset<3> func3, bitset<12> Imm_I, RegisterFile &myRF)
+    // Data cache miss in MEM: WB gets a bubble and everything from MEM back to IF keeps its
+    // instruction. WB has just written the register file, so a held EX picks up that result
+    // here, it would not be forwarded again next cycle.
+    template <typename Config>
+    void holdForMemory()
     {
-        int32_t rs1_val = static_cast<int32_t>(myRF.readRF(rs1).to_ulong());
-        int32_t imm_val = signExtend(Imm_I, 12); // Convert to signed 32-bit
-        int32_t result = 0;
+        nextState->WB = state->WB;
+        nextState->WB.nop = true;
+        nextState->MEM = state->MEM;
+        nextState->EX = state->EX;
+        nextState->ID = state->ID;
+        nextState->IF = state->IF;
+
+        EXStruct &ex = nextState->EX;
+        const WBStruct &wb = state->WB;
+        if (!wb.nop && wb.wrt_enable && wb.rd != 0)
+        {
+            if (ex.rs1 == wb.rd)
+                ex.Read_data1 = wb.Wrt_data;
+            if (ex.rs2 == wb.rd)
+                ex.Read_data2 = wb.Wrt_data;
+        }
+
+        if (fetchPending && fetchWait > 0) // an instruction miss keeps going in the background
+            fetchWait--;
 
-        if (func3 == bitset<3>("000")) // ADDI
-            result = rs1_val + imm_val;
-        else if (func3 == bitset<3>("100")) // XORI
-            result = rs1_val ^ imm_val;
-        else if (func3 == bitset<3>("110")) // ORI
-            result = rs1_val | imm_val;
-        else if (func3 == bitset<3>("111")) // ANDI
-            result = rs1_val & imm_val;
+        endCycle<Config>();
+    }
 
-        return bitset<32>(result); // Return the ALU result
+    // Fills the ID/EX latch for the instruction in `id`, fields the format does not use are 0.
+    // Shared with SuperscalarCore, which decodes several of these per cycle.
+    static void decodeToEX(EXStruct &exNext, const IDStruct &id, const MicroOp &uop, RegisterFile &rf)
+    {
+        exNext.PC = id.PC;
+        exNext.Next_PC = id.Next_PC;
+        exNext.Instr = uop.raw;
+        exNext.rs1 = uop.rs1;
+        exNext.rs2 = uop.rs2;
+        exNext.rd = uop.rd;
+        exNext.func3 = uop.funct3;
+        exNext.func7 = uop.funct7;
+        exNext.Imm = uop.imm;
+        exNext.Read_data1 = rf.readRF(uop.rs1);
+        exNext.Read_data2 = rf.readRF(uop.rs2);
+        exNext.alu_op = false;
+        exNext.nop = false;
+
+        switch (uop.opClass)
+        {
+        case OPC_RTYPE:
+        case OPC_MULDIV:
+            setControl(exNext, false, false, false, true);
+            break;
+        case OPC_ITYPE:
+            setControl(exNext, true, false, false, true);
+            break;
+        case OPC_LOAD:
+            setControl(exNext, true, true, false, true);
+            break;
+        case OPC_STORE:
+            setControl(exNext, false, false, true, false);
+            break;
+        case OPC_BRANCH:
+            setControl(exNext, false, false, false, false);
+            break;
+        case OPC_JAL:
+        case OPC_LUI:
+        case OPC_AUIPC:
+            setControl(exNext, false, false, false, true);
+            break;
+        case OPC_JALR:
+            setControl(exNext, true, false, false, true);
+            break;
+        case OPC_FENCE:
+        case OPC_ILLEGAL: // trap in EX
+        case OPC_SYSTEM:
+            setControl(exNext, false, false, false, false);
+            break;
+        default: // the halt never gets past IF, send a bubble down the pipe
+            setControl(exNext, false, false, false, false);
+            exNext.nop = true;
+            break;
+        }
     }
 
-    bitset<32> handleLoad(bitset<5> rs1, bitset<12> Imm_I, RegisterFile &myRF)
+    static void setControl(EXStruct &ex, bool is_I_type, bool rd_mem, bool wrt_mem, bool wrt_enable)
     {
-        int32_t rs1_val = static_cast<int32_t>(myRF.readRF(rs1).to_ulong());
-        int32_t imm_val = signExtend(Imm_I, 12); // Convert to signed 32-bit
-        int32_t address = rs1_val + imm_val;
-        return bitset<32>(address); // Return the memory address
+        ex.is_I_type = is_I_type;
+        ex.rd_mem = rd_mem;
+        ex.wrt_mem = wrt_mem;
+        ex.wrt_enable = wrt_enable;
     }
 
-    pair<bitset<32>, bitset<32>> handleStore(bitset<5> rs1, bitset<5> rs2, bitset<12> Imm_S, RegisterFile &myRF)
+    // Value of register `reg` for the instruction in EX. The EX/MEM latch holds the result of
+    // the previous instruction and MEM/WB the one before it; the register file read in ID
+    // already includes everything older. Loads never reach the EX/MEM path, ID stalls them.
+    uint32_t forwardOperand(uint8_t reg, uint32_t readValue)
     {
-        int32_t rs1_val = static_cast<int32_t>(myRF.readRF(rs1).to_ulong());
-        int32_t rs2_val = static_cast<int32_t>(myRF.readRF(rs2).to_ulong());
-        int32_t imm_val = signExtend(Imm_S, 12); // Convert to signed 32-bit
-        int32_t address = rs1_val + imm_val;
-        return {bitset<32>(address), bitset<32>(rs2_val)}; // Return address and store data
+        if (reg == 0)
+            return readValue;
+        if (!state->MEM.nop && state->MEM.wrt_enable && !state->MEM.rd_mem && state->MEM.rd == reg)
+        {
+            forwardsFromMEM++;
+            return state->MEM.ALUresult;
+        }
+        if (!state->WB.nop && state->WB.wrt_enable && state->WB.rd == reg)
+        {
+            forwardsFromWB++;
+            return state->WB.Wrt_data;
+        }
+        return readValue;
     }
 
-    void handleBranch(bitset<5> rs1, bitset<5> rs2, bitset<3> func3, bitset<12> Imm_B, bitset<32> PC, stateStruct &nextState, RegisterFile &myRF)
+    static uint32_t handleLoad(uint32_t rs1_val, int32_t Imm)
     {
-        int32_t rs1_val = static_cast<int32_t>(myRF.readRF(rs1).to_ulong());
-        int32_t rs2_val = static_cast<int32_t>(myRF.readRF(rs2).to_ulong());
-        int32_t imm_val = signExtend(Imm_B, 13); // Convert to signed 32-bit
-        bool branchTaken = false;
+        return rs1_val + static_cast<uint32_t>(Imm); // Return the memory address
+    }
 
-        if (func3 == bitset<3>("000")) // BEQ
-            branchTaken = (rs1_val == rs2_val);
-        else if (func3 == bitset<3>("001")) // BNE
-            branchTaken = (rs1_val != rs2_val);
+    static pair<uint32_t, uint32_t> handleStore(uint32_t rs1_val, uint32_t rs2_val, int32_t Imm)
+    {
+        return {rs1_val + static_cast<uint32_t>(Imm), rs2_val}; // Return address and store data
+    }
 
-        // Update the next PC based on whether the branch is taken
-        nextState.IF.PC = branchTaken
-                              ? bitset<32>(PC.to_ulong() + imm_val)
-                              : bitset<32>(PC.to_ulong() + 4);
+    static uint32_t handleBranch(uint8_t op, uint32_t rs1_val, uint32_t rs2_val, int32_t Imm, uint32_t PC) // returns the resolved next PC
+    {
+        bool taken = branchTaken(op, rs1_val, rs2_val);
+        uint32_t nextPC = taken ? PC + Imm : PC + 4;
+        SIM_EVENT(LOG_BRANCH, LOG_DEBUG, EV_BRANCH, PC, taken, nextPC);
+        return nextPC;
+    }
 
-        cout << "Branch " << (branchTaken ? "Taken" : "Not Taken") << ", New PC=" << nextState.IF.PC << endl;
+    static uint32_t handleJump(uint8_t rd, uint32_t targetPC, uint32_t PC) // JAL and JALR, WB writes PC + 4 to rd
+    {
+        SIM_EVENT(LOG_BRANCH, LOG_DEBUG, EV_JUMP, PC, rd, targetPC);
+        return targetPC;
     }
 
-    void handleJump(bitset<5> rd, bitset<20> Imm_J, bitset<32> PC, stateStruct &nextState, RegisterFile &myRF)
+    template <typename Config>
+    typename Config::Predictor &predictorAs() // the predictor as the type Config was compiled for
     {
-        int32_t imm_val = signExtend(Imm_J, 20); // Convert to signed 32-bit
-        bitset<32> targetPC = bitset<32>(PC.to_ulong() + imm_val);
+        return static_cast<typename Config::Predictor &>(*predictor);
+    }
 
-        // Write the return address (PC + 4) to the destination register
-        if (rd.to_ulong() != 0) // Avoid writing to x0
-        {
-            bitset<32> returnAddress = bitset<32>(PC.to_ulong() + 4);
-            myRF.writeRF(rd, returnAddress);
-            cout << "Jump: Writing return address to Register[" << rd << "] = " << returnAddress << endl;
-        }
+    template <typename Latch>
+    static bool writesSource(const Latch &latch, const MicroOp &uop) // the latch's instruction produces rs1 or rs2 of uop
+    {
+        return !latch.nop && latch.wrt_enable && latch.rd != 0 && (latch.rd == uop.rs1 || latch.rd == uop.rs2);
+    }
 
-        // Update PC for the next instruction
-        nextState.IF.PC = targetPC;
-        cout << "Jump to PC=" << targetPC << endl;
+    template <typename Config>
+    uint32_t predictNextPC(uint32_t PC) // fetch address after PC: BTB target if predicted taken, else PC + 4
+    {
+        uint32_t target;
+        bool conditional;
+        if (btb.lookup(PC, target, conditional) && (!conditional || predictorAs<Config>().predict(PC)))
+            return target;
+        return PC + 4;
     }
 
     void handleHalt(stateStruct &nextState)
@@ -1018,51 +1665,78 @@ public:
         nextState.MEM.nop = true;
         nextState.WB.nop = true;
 
-        cout << "HALT: Pipeline stopped." << endl;
-    }
-
-    void printState(stateStruct state, int cycle)
-    { // output for StateResult
-        ofstream printstate(opFilePath, cycle == 0 ? std::ios_base::trunc : std::ios_base::app);
-        if (printstate.is_open())
-        {
-            printstate << "----------------------------------------------------------------------\n";
-            printstate << "State after executing cycle: " << cycle << "\n";
-            printstate << "IF.nop: " << (state.IF.nop ? "True" : "False") << "\n";
-            printstate << "IF.PC: " << state.IF.PC.to_ulong() << "\n";
-            printstate << "ID.nop: " << (state.ID.nop ? "True" : "False") << "\n";
-            printstate << "ID.Instr: " << state.ID.Instr << "\n";
-            printstate << "EX.nop: " << (state.EX.nop ? "True" : "False") << "\n";
-            printstate << "EX.Instr: " << state.EX.Instr << "\n";
-            printstate << "EX.Read_data1: " << state.EX.Read_data1 << "\n";
-            printstate << "EX.Read_data2: " << state.EX.Read_data2 << "\n";
-            printstate << "EX.Imm: " << state.EX.Imm << "\n";
-            printstate << "EX.Rs1: " << state.EX.rs1 << "\n";
-            printstate << "EX.Rs2: " << state.EX.rs2 << "\n";
-            printstate << "EX.Rd: " << state.EX.rd << "\n";
-            printstate << "EX.is_I_type: " << state.EX.is_I_type << "\n";
-            printstate << "EX.rd_mem: " << state.EX.rd_mem << "\n";
-            printstate << "EX.wrt_mem: " << state.EX.wrt_mem << "\n";
-            printstate << "EX.alu_op: " << (state.EX.alu_op ? "01" : "00") << "\n";
-            printstate << "EX.wrt_enable: " << state.EX.wrt_enable << "\n";
-            printstate << "MEM.nop: " << (state.MEM.nop ? "True" : "False") << "\n";
-            printstate << "MEM.ALUresult: " << state.MEM.ALUresult << "\n";
-            printstate << "MEM.Store_data: " << state.MEM.Store_data << "\n";
-            printstate << "MEM.Rs1: " << state.MEM.rs1 << "\n";
-            printstate << "MEM.Rs2: " << state.MEM.rs2 << "\n";
-            printstate << "MEM.Rd: " << state.MEM.rd << "\n";
-            printstate << "MEM.rd_mem: " << state.MEM.rd_mem << "\n";
-            printstate << "MEM.wrt_mem: " << state.MEM.wrt_mem << "\n";
-            printstate << "MEM.wrt_enable: " << state.MEM.wrt_enable << "\n";
-            printstate << "WB.nop: " << (state.WB.nop ? "True" : "False") << "\n";
-            printstate << "WB.Wrt_data: " << state.WB.Wrt_data << "\n";
-            printstate << "WB.Rs1: " << state.WB.rs1 << "\n";
-            printstate << "WB.Rs2: " << state.WB.rs2 << "\n";
-            printstate << "WB.rd: " << state.WB.rd << "\n";
-            printstate << "WB.wrt_enable: " << state.WB.wrt_enable << "\n";
-        }
-
-        printstate.close();
+        SIM_EVENT(LOG_PIPELINE, LOG_INFO, EV_HALT, state->IF.PC);
+    }
+
+    int instructionCount() const
+    {
+        return totalInstructions;
+    }
+
+    uint8_t checkpointKind() const { return CHECKPOINT_FIVE_STAGE; }
+
+    vector<uint64_t> saveCounters() const // instructions, halt flag, then the registry in registration order
+    {
+        vector<uint64_t> values = {static_cast<uint64_t>(totalInstructions), halt};
+        for (const CounterRegistry::Counter &c : counters.all())
+            values.push_back(*c.value);
+        return values;
+    }
+
+    void restoreCounters(const vector<uint64_t> &values)
+    {
+        totalInstructions = values.size() > 0 ? values[0] : 0;
+        halt = values.size() > 1 && values[1] != 0;
+        const vector<CounterRegistry::Counter> &registered = counters.all();
+        for (size_t i = 0; i < registered.size(); i++)
+            *registered[i].value = i + 2 < values.size() ? values[i + 2] : 0;
+    }
+
+    void saveMicroarch(ostream &out) const
+    {
+        string name = predictor->name();
+        putU8(out, name.size());
+        out.write(name.data(), name.size());
+        predictor->save(out);
+        btb.save(out);
+        putU8(out, fetchPending);
+        putU32(out, fetchWait);
+        putU8(out, memPending);
+        putU32(out, memWait);
+        mulDiv.save(out);
+        scoreboard.save(out);
+        caches.save(out);
+    }
+
+    bool restoreMicroarch(istream &in)
+    {
+        string name(getU8(in), '\0');
+        in.read(&name[0], name.size());
+        if (name != predictor->name()) // tables of another predictor type cannot be loaded
+            return false;
+        predictor->load(in);
+        btb.load(in);
+        fetchPending = getU8(in) != 0;
+        fetchWait = getU32(in);
+        memPending = getU8(in) != 0;
+        memWait = getU32(in);
+        mulDiv.load(in);
+        scoreboard.load(in);
+        return caches.load(in);
+    }
+
+    void outputProfile() // FS_Profile.folded for flamegraph tools, FS_Profile.txt per-PC table
+    {
+        ofstream folded(ioDir + "Profile.folded");
+        ofstream table(ioDir + "Profile.txt");
+        if (!folded.is_open() || !table.is_open())
+        {
+            console() << "Unable to open profile output files." << endl;
+            return;
+        }
+        profiler->writeCollapsed(folded);
+        profiler->writeTable(table, [this](uint32_t PC)
+                             { return ext_imem.decodeAt(PC).raw; });
     }
 
     void outputPerformanceMetrics()
@@ -1078,63 +1752,1321 @@ public:
             metricsOut << "#Instructions -> " << totalInstructions << endl;
             metricsOut << "CPI -> " << cpi << endl;
             metricsOut << "IPC -> " << ipc << endl;
+            metricsOut << "#Load-use stall cycles -> " << loadUseStalls << endl;
+            if (!forwarding)
+                metricsOut << "#Other RAW stall cycles (forwarding off) -> " << rawStalls << endl;
+            if (mixMulDiv > 0)
+            {
+                metricsOut << "#Multiply/divide instructions -> " << mixMulDiv << endl;
+                metricsOut << "#Multiply/divide result stall cycles -> " << scoreboardStalls << endl;
+                metricsOut << "#Busy multiplier/divider stall cycles -> " << structuralStalls << endl;
+            }
+            metricsOut << "#Operands forwarded EX/MEM->EX -> " << forwardsFromMEM << endl;
+            metricsOut << "#Operands forwarded MEM/WB->EX -> " << forwardsFromWB << endl;
+            metricsOut << "#Branch predictor -> " << predictor->name() << endl;
+            metricsOut << "#Branches -> " << branches << endl;
+            metricsOut << "#Branch mispredictions -> " << branchMispredicts << endl;
+            metricsOut << "#Branch prediction accuracy -> " << (branches ? 1.0f - static_cast<float>(branchMispredicts) / branches : 1.0f) << endl;
+            metricsOut << "#Jumps -> " << jumps << endl;
+            metricsOut << "#Jump target mispredictions -> " << jumpMispredicts << endl;
+            metricsOut << "#Flush penalty cycles -> " << flushCycles << endl;
+            metricsOut << "#Instruction fetch stall cycles -> " << fetchStallCycles << endl;
+            metricsOut << "#Data memory stall cycles -> " << memStallCycles << endl;
+            caches.forEachCache([&](const Cache &c)
+                                {
+                                    uint64_t accesses = c.hits + c.misses;
+                                    metricsOut << "#" << c.cacheName() << " hits -> " << c.hits << endl;
+                                    metricsOut << "#" << c.cacheName() << " misses -> " << c.misses << endl;
+                                    metricsOut << "#" << c.cacheName() << " hit rate -> " << (accesses ? static_cast<float>(c.hits) / accesses : 0.0f) << endl;
+                                    metricsOut << "#" << c.cacheName() << " evictions -> " << c.evictions << endl;
+                                    metricsOut << "#" << c.cacheName() << " writebacks -> " << c.writebacks << endl;
+                                    if (c.coherent())
+                                    {
+                                        metricsOut << "#" << c.cacheName() << " upgrades -> " << c.upgrades << endl;
+                                        metricsOut << "#" << c.cacheName() << " invalidations -> " << c.invalidations << endl;
+                                        metricsOut << "#" << c.cacheName() << " interventions -> " << c.interventions << endl;
+                                    } });
 
             metricsOut.close();
+            outputCounters(counterPath, "five-stage", totalInstructions);
+            if (profiler)
+                outputProfile();
         }
         else
         {
-            cout << "Unable to open performance metrics output file." << endl;
+            console() << "Unable to open performance metrics output file." << endl;
         }
     }
 
 private:
     string opFilePath;
     string perfFilePath;
+    string counterPath; // .json/.csv counter dumps
     int totalInstructions = 0;
     bool halt = false; // Global halt flag to signal termination
+    uint64_t loadUseStalls = 0;   // cycles ID held an instruction that needs the load in EX
+    uint64_t rawStalls = 0;       // other cycles ID waited for a source, only with forwarding off
+    uint64_t forwardsFromMEM = 0; // operands taken from the EX/MEM latch
+    uint64_t forwardsFromWB = 0;  // operands taken from the MEM/WB latch
+    unique_ptr<BranchPredictor> predictor = makeBranchPredictor("static");
+    BranchTargetBuffer btb;
+    uint64_t branches = 0;
+    uint64_t branchMispredicts = 0;
+    uint64_t jumps = 0;
+    uint64_t jumpMispredicts = 0;  // JAL fetched without a BTB hit
+    uint64_t flushCycles = 0;      // fetch slots squashed on redirects, 2 per misprediction
+    CacheHierarchy caches;
+    AccessOrder *accessOrder = nullptr; // --cores: turns for the bus and the shared DataMem
+    unsigned coreId = 0;
+    bool fetchPending = false; // IF has looked up the current PC in L1I
+    uint32_t fetchWait = 0;    // cycles until that instruction arrives
+    bool memPending = false;   // the load/store in MEM has been sent to L1D
+    uint32_t memWait = 0;
+    uint64_t fetchStallCycles = 0; // cycles IF waited for L1I
+    uint64_t memStallCycles = 0;   // cycles the pipeline waited for L1D
+    uint64_t bubbles[5] = {};      // per latch IF, ID, EX, MEM, WB: cycles it started empty
+    uint64_t mixRType = 0;         // instruction mix, counted in EX where nothing is squashed any more
+    uint64_t mixIType = 0;
+    uint64_t mixLoads = 0;
+    uint64_t mixStores = 0;
+    uint64_t mixMulDiv = 0;
+    uint64_t takenBranches = 0;
+    MulDivUnits mulDiv;
+    Scoreboard scoreboard;         // destinations of multiplies and divides still in their unit
+    uint64_t scoreboardStalls = 0; // cycles ID waited for one of them
+    uint64_t structuralStalls = 0; // cycles a multiply or divide waited in ID for its unit
+    unique_ptr<PcProfiler> profiler; // --profile only
+    bool idleSkip = true;
+    uint32_t skipHorizon = 0;
+    bool forwarding = true;
 };
 
-int main(int argc, char *argv[])
+// Functional unit classes of SuperscalarCore and how many of each one cycle can issue to
+enum FunctionalUnit
 {
-    string ioDir = "";
+    FU_ALU,    // R- and I-type arithmetic
+    FU_BRANCH, // conditional branches and jumps
+    FU_MEMORY, // loads and stores
+    FU_COUNT
+};
 
-    // Command-line argument handling
-    if (argc == 3 && string(argv[1]) == "--iodir")
+struct FunctionalUnits
+{
+    int count[FU_COUNT] = {0, 1, 1}; // ALU count 0 = one per issue slot
+};
+
+bool parseFunctionalUnits(const string &spec, FunctionalUnits &units) // "ALU,BRANCH,MEMORY", e.g. "2,1,1"
+{
+    stringstream in(spec);
+    string part;
+    for (int u = 0; u < FU_COUNT; u++)
     {
-        ioDir = argv[2];
-        cout << "IO Directory: " << ioDir << endl;
+        if (!getline(in, part, ','))
+            return false;
+        try
+        {
+            units.count[u] = stoi(part);
+        }
+        catch (const exception &)
+        {
+            return false;
+        }
+        if (units.count[u] < 1)
+            return false;
     }
-    else if (argc == 1)
+    return true;
+}
+
+// In-order superscalar variant of FiveStageCore: IF, ID, EX, MEM and WB each hold a bundle
+// of up to Width instructions. IF fetches Width sequential instructions, ending the bundle
+// early after a predicted-taken branch or jump or at the halt. ID issues the bundle in
+// order and stops at the first instruction that
+//   - needs a load that is still in EX (load-use, as in the scalar core) or a multiply or
+//     divide result the scoreboard still marks pending,
+//   - needs the result of an older instruction issued in the same cycle (intra-bundle
+//     dependency; it issues next cycle and gets the value forwarded), or
+//   - finds every functional unit of its class taken, or the multiplier or divider busy
+//     (structural hazard).
+// What did not issue stays in ID and IF waits. EX forwards from the EX/MEM and MEM/WB
+// bundles, youngest writer first, and resolves branches; a misprediction squashes the
+// younger instructions in EX, the whole ID bundle and the fetch, like the scalar core.
+//
+// With Width 1 the cycle counts and traces are those of FiveStageCore without caches.
+// The state trace shows slot 0 of every stage. Caches and checkpoints are not modelled.
+template <int Width>
+class SuperscalarCore : public Core
+{
+public:
+    SuperscalarCore(string ioDir, InsMem &imem, DataMem &dmem, TraceMode traceMode = TRACE_TEXT)
+        : Core(joinPath(ioDir, coreName() + "_"), imem, dmem),
+          perfFilePath(joinPath(ioDir, "PerformanceMetrics_" + coreName() + ".txt")),
+          counterPath(joinPath(ioDir, "PerformanceMetrics_" + coreName()))
     {
-        cout << "Enter path containing the memory files: ";
-        cin >> ioDir;
+        trace.open(myRF.outputFile, joinPath(ioDir, "StateResult_" + coreName() + ".txt"), this->ioDir + "Trace.bin", TRACE_FIVE_STAGE, traceMode);
+        units.count[FU_ALU] = Width;
+        for (int i = 0; i < Width; i++)
+        {
+            state->ID[i].nop = true;
+            nextState->ID[i].nop = true;
+        }
+
+        counters.add("stall.load_use", loadUseStalls, "cycles issue stopped at an instruction needing a load in EX");
+        counters.add("stall.raw", rawStalls, "cycles issue stopped at any other result in EX or MEM, forwarding off");
+        counters.add("stall.intra_bundle", intraBundleStalls, "cycles issue stopped at a dependency inside the bundle");
+        counters.add("stall.structural.alu", structuralStalls[FU_ALU], "cycles issue stopped for lack of an ALU");
+        counters.add("stall.structural.branch", structuralStalls[FU_BRANCH], "cycles issue stopped for lack of a branch unit");
+        counters.add("stall.structural.memory", structuralStalls[FU_MEMORY], "cycles issue stopped for lack of a memory port");
+        counters.add("stall.flush", flushCycles, "fetch slots squashed by mispredictions, 2 per misprediction");
+        for (int k = 0; k <= Width; k++)
+            counters.add("issue." + to_string(k), issueHistogram[k], "cycles issuing " + to_string(k) + " instructions");
+        counters.add("mix.rtype", mixRType, "register-register ALU instructions executed");
+        counters.add("mix.itype", mixIType, "register-immediate ALU instructions executed");
+        counters.add("mix.load", mixLoads, "loads executed");
+        counters.add("mix.store", mixStores, "stores executed");
+        counters.add("mix.branch", branches, "conditional branches executed");
+        counters.add("mix.jal", jumps, "jumps executed");
+        counters.add("branch.taken", takenBranches, "conditional branches taken");
+        counters.add("branch.mispredicted", branchMispredicts, "conditional branches with a wrong predicted next PC");
+        counters.add("jump.mispredicted", jumpMispredicts, "jumps fetched without the right BTB target");
+        counters.add("forward.EX_MEM", forwardsFromMEM, "operands taken from the EX/MEM bundle");
+        counters.add("forward.MEM_WB", forwardsFromWB, "operands taken from the MEM/WB bundle");
+        counters.add("mix.muldiv", mixMulDiv, "multiplications and divisions executed");
+        counters.add("stall.scoreboard", scoreboardStalls, "cycles issue stopped at an instruction needing a multiply or divide result");
+        counters.add("stall.structural.muldiv", mulDivStalls, "cycles issue stopped at a busy divider or multiplier");
     }
-    else
+
+    static string coreName() { return "FSx" + to_string(Width); }
+
+    void setBranchPredictor(unique_ptr<BranchPredictor> bp)
     {
-        cout << "Invalid number of arguments. Usage: ./main --iodir <path_to_directory>" << endl;
-        return -1;
+        predictor = move(bp);
     }
 
-    InsMem imem = InsMem("Imem", ioDir);
-    // DataMem dmem_ss = DataMem("SS", ioDir);
-    DataMem dmem_fs = DataMem("FS", ioDir);
+    void setFunctionalUnits(const FunctionalUnits &fu) // ALU count 0 keeps one ALU per slot
+    {
+        for (int u = 0; u < FU_COUNT; u++)
+            if (fu.count[u] > 0)
+                units.count[u] = fu.count[u];
+    }
 
-    // SingleStageCore SSCore(ioDir, imem, dmem_ss);
-    FiveStageCore FSCore(ioDir, imem, dmem_fs);
+    void setMulDiv(const MulDivSetup &setup)
+    {
+        mulDiv.configure(setup);
+    }
 
-    while (!FSCore.halted) // Exit loop if halt flag is true
+    void setForwarding(bool enabled) // off: issue waits until a source's producer has left MEM
     {
-        FSCore.step();
+        forwarding = enabled;
     }
 
-    dmem_fs.outputDataMem();
+    void loadArchState(uint32_t PC, const RegisterFile &rf)
+    {
+        stateBuffers[0] = WideState<Width>();
+        stateBuffers[1] = WideState<Width>();
+        for (int i = 0; i < Width; i++)
+        {
+            state->ID[i].nop = true;
+            nextState->ID[i].nop = true;
+        }
+        state->IF.PC = PC;
+        nextState->IF.PC = PC;
+        myRF.loadRegisters(rf.registers());
+        halted = false;
+    }
 
-    FSCore.outputPerformanceMetrics();
+    void step()
+    {
+        SIM_EVENT_SCOPE(events, cycle);
+        SIM_EVENT(LOG_PIPELINE, LOG_DEBUG, EV_CYCLE, cycle);
 
-    // Use outputDataMem to output data memory
-    // SSCore.getDataMem().outputDataMem();
+        /* --------------------- WB stage --------------------- */
+        for (int i = 0; i < Width; i++) // in program order, so the youngest write to a register wins
+        {
+            const WBStruct &wb = state->WB[i];
+            if (wb.nop)
+                continue;
+            totalInstructions++;
+            if (wb.wrt_enable && wb.rd != 0)
+                myRF.writeRF(wb.rd, wb.Wrt_data);
+
+            lastCommit.PC = wb.PC;
+            lastCommit.cycle = cycle;
+            lastCommit.rd = wb.rd;
+            lastCommit.wrt_enable = wb.wrt_enable && wb.rd != 0;
+            lastCommit.Wrt_data = wb.Wrt_data;
+            lastCommit.wrt_mem = wb.wrt_mem;
+            lastCommit.Store_addr = wb.Store_addr;
+            lastCommit.Store_data = wb.Store_data;
+            retire();
+        }
 
-    // SSCore.outputPerformanceMetrics();
+        /* --------------------- MEM stage --------------------- */
+        for (int i = 0; i < Width; i++)
+        {
+            const MEMStruct &mem = state->MEM[i];
+            WBStruct &wbNext = nextState->WB[i];
+            if (mem.nop)
+            {
+                wbNext = state->WB[i];
+                wbNext.nop = true;
+                continue;
+            }
 
-    return 0;
+            if (mem.rd_mem)
+            {
+                uint8_t op = ext_imem.decodeAt(mem.PC).op;
+                wbNext.Wrt_data = loadResult(op, ext_dmem.readDataMem(mem.ALUresult, accessBytes(op)));
+            }
+            else if (mem.wrt_mem)
+            {
+                ext_dmem.writeDataMem(mem.ALUresult, mem.Store_data, accessBytes(ext_imem.decodeAt(mem.PC).op));
+                wbNext.Wrt_data = state->WB[i].Wrt_data; // stores have nothing to write back
+            }
+            else
+                wbNext.Wrt_data = mem.ALUresult;
+
+            wbNext.PC = mem.PC;
+            wbNext.Store_addr = mem.ALUresult;
+            wbNext.Store_data = mem.Store_data;
+            wbNext.rs1 = mem.rs1;
+            wbNext.rs2 = mem.rs2;
+            wbNext.rd = mem.rd;
+            wbNext.wrt_mem = mem.wrt_mem;
+            wbNext.wrt_enable = mem.wrt_enable;
+            wbNext.nop = false;
+        }
+
+        /* --------------------- EX stage --------------------- */
+        bool redirect = false; // a slot mispredicted, everything younger is on the wrong path
+        uint32_t redirectPC = 0;
+        uint32_t redirectFrom = 0;
+        bool trap = false; // a slot trapped, nothing younger may run
+        for (int i = 0; i < Width; i++)
+        {
+            const EXStruct &ex = state->EX[i];
+            MEMStruct &memNext = nextState->MEM[i];
+            if (ex.nop || redirect || trap)
+            {
+                memNext = state->MEM[i];
+                memNext.nop = true;
+                continue;
+            }
+
+            uint32_t operand1 = forwarding ? forwardOperand(ex.rs1, ex.Read_data1) : ex.Read_data1;
+            uint32_t operand2 = forwarding ? forwardOperand(ex.rs2, ex.Read_data2) : ex.Read_data2;
+
+            memNext.PC = ex.PC;
+            memNext.Store_data = operand2;
+            memNext.rs1 = ex.rs1;
+            memNext.rs2 = ex.rs2;
+            memNext.rd = ex.rd;
+            memNext.rd_mem = ex.rd_mem;
+            memNext.wrt_mem = ex.wrt_mem;
+            memNext.wrt_enable = ex.wrt_enable;
+            memNext.nop = false;
+
+            const MicroOp &uop = ext_imem.decodeAt(ex.PC);
+            switch (uop.opClass)
+            {
+            case OPC_LOAD:
+                mixLoads++;
+                memNext.ALUresult = FiveStageCore::handleLoad(operand1, ex.Imm);
+                break;
+            case OPC_STORE:
+            {
+                mixStores++;
+                auto storeResult = FiveStageCore::handleStore(operand1, operand2, ex.Imm);
+                memNext.ALUresult = storeResult.first;
+                memNext.Store_data = storeResult.second;
+                break;
+            }
+            case OPC_ITYPE:
+                mixIType++;
+                memNext.ALUresult = aluResult(uop.op, operand1, ex.Imm);
+                break;
+            case OPC_LUI:
+                mixIType++;
+                memNext.ALUresult = ex.Imm;
+                break;
+            case OPC_AUIPC:
+                mixIType++;
+                memNext.ALUresult = ex.PC + ex.Imm;
+                break;
+            case OPC_BRANCH:
+            {
+                uint32_t actualPC = FiveStageCore::handleBranch(uop.op, operand1, operand2, ex.Imm, ex.PC);
+                bool taken = actualPC != ex.PC + 4;
+                predictor->update(ex.PC, taken);
+                if (taken)
+                {
+                    btb.update(ex.PC, actualPC, true);
+                    takenBranches++;
+                }
+                branches++;
+                if (actualPC != ex.Next_PC)
+                {
+                    branchMispredicts++;
+                    redirect = true;
+                    redirectPC = actualPC;
+                    redirectFrom = ex.PC;
+                }
+                break;
+            }
+            case OPC_JAL:
+            case OPC_JALR:
+            {
+                uint32_t targetPC = FiveStageCore::handleJump(ex.rd, uop.opClass == OPC_JAL ? ex.PC + ex.Imm : (operand1 + ex.Imm) & ~1u, ex.PC);
+                memNext.ALUresult = ex.PC + 4;
+                btb.update(ex.PC, targetPC, false);
+                jumps++;
+                if (targetPC != ex.Next_PC)
+                {
+                    jumpMispredicts++;
+                    redirect = true;
+                    redirectPC = targetPC;
+                    redirectFrom = ex.PC;
+                }
+                break;
+            }
+            case OPC_MULDIV:
+                mixMulDiv++;
+                memNext.ALUresult = aluResult(uop.op, operand1, operand2);
+                scoreboard.reserve(ex.rd, mulDiv.unitFor(uop.op).start(cycle));
+                break;
+            case OPC_FENCE:
+                break;
+            case OPC_ILLEGAL:
+            case OPC_SYSTEM:
+                raiseTrap(trapCauseOf(uop.op), ex.PC, uop.raw);
+                memNext.nop = true;
+                trap = true;
+                break;
+            default:
+                mixRType++;
+                memNext.ALUresult = aluResult(uop.op, operand1, operand2);
+                break;
+            }
+        }
+
+        /* --------------------- ID stage --------------------- */
+        int issued = 0; // instructions sent to EX, which is also the number of ID slots consumed
+        int used[FU_COUNT] = {0, 0, 0};
+        bool claimed[2] = {false, false}; // multiplier, divider: each takes one new operation per cycle
+        scoreboard.advance(cycle);
+        for (; issued < Width && !state->ID[issued].nop; issued++)
+        {
+            const IDStruct &id = state->ID[issued];
+            const MicroOp &uop = ext_imem.decodeAt(id.PC);
+
+            if (scoreboard.blocks(uop))
+            {
+                scoreboardStalls++;
+                break;
+            }
+            const ExecUnit *mulDivUnit = uop.opClass == OPC_MULDIV ? &mulDiv.unitFor(uop.op) : nullptr;
+            if (mulDivUnit && (!mulDivUnit->accepts(cycle + 1) || claimed[mulDivUnit == &mulDiv.div]))
+            {
+                mulDivStalls++;
+                break;
+            }
+            if (loadInEX(uop))
+            {
+                loadUseStalls++;
+                SIM_EVENT(LOG_PIPELINE, LOG_INFO, EV_LOAD_USE_STALL, 0, uop.rs1, uop.rs2);
+                break;
+            }
+            if (!forwarding && resultInFlight(uop))
+            {
+                rawStalls++;
+                break;
+            }
+            if (dependsOnIssued(uop, issued))
+            {
+                intraBundleStalls++;
+                break;
+            }
+            int unit = unitOf(uop);
+            if (unit < FU_COUNT && used[unit] == units.count[unit])
+            {
+                structuralStalls[unit]++;
+                break;
+            }
+
+            FiveStageCore::decodeToEX(nextState->EX[issued], id, uop, myRF);
+            if (unit < FU_COUNT)
+                used[unit]++;
+            if (mulDivUnit)
+                claimed[mulDivUnit == &mulDiv.div] = true;
+        }
+        for (int i = issued; i < Width; i++)
+        {
+            nextState->EX[i] = state->EX[i];
+            nextState->EX[i].nop = true;
+        }
+
+        /* --------------------- IF stage --------------------- */
+        if (issued < Width && !state->ID[issued].nop)
+        {
+            // Part of the bundle is still waiting: keep it (moved to the front) and hold IF
+            for (int i = 0; i < Width; i++)
+            {
+                nextState->ID[i] = state->ID[i + issued < Width ? i + issued : i];
+                if (i + issued >= Width)
+                    nextState->ID[i].nop = true;
+            }
+            nextState->IF = state->IF;
+        }
+        else if (!state->IF.nop)
+        {
+            uint32_t PC = state->IF.PC;
+            int fetched = 0;
+            nextState->IF = state->IF;
+            while (fetched < Width)
+            {
+                uint32_t instruction = ext_imem.readInstr(PC);
+                if (instruction == 0xFFFFFFFF) // HALT instruction, nothing after it is fetched
+                {
+                    SIM_EVENT(LOG_PIPELINE, LOG_INFO, EV_HALT, PC);
+                    nextState->IF.nop = true;
+                    halt = true;
+                    break;
+                }
+                IDStruct &idNext = nextState->ID[fetched++];
+                idNext.PC = PC;
+                idNext.Instr = instruction;
+                idNext.nop = false;
+                idNext.Next_PC = predictNextPC(PC);
+                PC = idNext.Next_PC;
+                if (PC != idNext.PC + 4) // predicted taken, the rest of the line is not on the path
+                    break;
+            }
+            nextState->IF.PC = PC;
+            for (int i = fetched; i < Width; i++)
+            {
+                nextState->ID[i] = state->ID[i];
+                nextState->ID[i].nop = true;
+            }
+        }
+        else
+        {
+            nextState->IF = state->IF;
+            for (int i = 0; i < Width; i++)
+            {
+                nextState->ID[i] = state->ID[i];
+                nextState->ID[i].nop = true;
+            }
+        }
+
+        if (redirect)
+        {
+            SIM_EVENT(LOG_BRANCH, LOG_INFO, EV_REDIRECT, redirectFrom, redirectPC);
+            for (int i = 0; i < Width; i++)
+            {
+                nextState->EX[i].nop = true;
+                nextState->ID[i].nop = true;
+            }
+            nextState->IF.PC = redirectPC;
+            nextState->IF.nop = false;
+            halt = false;
+            flushCycles += 2;
+        }
+        else if (trap)
+        {
+            for (int i = 0; i < Width; i++)
+            {
+                nextState->EX[i].nop = true;
+                nextState->ID[i].nop = true;
+            }
+            nextState->IF.nop = true;
+            halt = true;
+        }
+
+        if (pipelineEmpty())
+        {
+            halted = true;
+            console() << "Program halted." << endl;
+            return;
+        }
+
+        issueHistogram[issued]++;
+        traceCycle(slotZero(*nextState), cycle);
+        swap(state, nextState);
+        cycle++;
+    }
+
+    int instructionCount() const
+    {
+        return totalInstructions;
+    }
+
+    void outputPerformanceMetrics()
+    {
+        ofstream metricsOut(perfFilePath);
+        if (metricsOut.is_open())
+        {
+            float cpi = static_cast<float>(cycle) / totalInstructions;
+            float ipc = static_cast<float>(totalInstructions) / cycle;
+
+            metricsOut << "-----------------------------Performance of " << Width << "-wide Five Stage-----------------------------" << endl;
+            metricsOut << "#Cycles -> " << cycle << endl;
+            metricsOut << "#Instructions -> " << totalInstructions << endl;
+            metricsOut << "CPI -> " << cpi << endl;
+            metricsOut << "IPC -> " << ipc << endl;
+            metricsOut << "#Load-use stall cycles -> " << loadUseStalls << endl;
+            if (!forwarding)
+                metricsOut << "#Other RAW stall cycles (forwarding off) -> " << rawStalls << endl;
+            metricsOut << "#Operands forwarded EX/MEM->EX -> " << forwardsFromMEM << endl;
+            metricsOut << "#Operands forwarded MEM/WB->EX -> " << forwardsFromWB << endl;
+            metricsOut << "#Branch predictor -> " << predictor->name() << endl;
+            metricsOut << "#Branches -> " << branches << endl;
+            metricsOut << "#Branch mispredictions -> " << branchMispredicts << endl;
+            metricsOut << "#Branch prediction accuracy -> " << (branches ? 1.0f - static_cast<float>(branchMispredicts) / branches : 1.0f) << endl;
+            metricsOut << "#Jumps -> " << jumps << endl;
+            metricsOut << "#Jump target mispredictions -> " << jumpMispredicts << endl;
+            metricsOut << "#Flush penalty cycles -> " << flushCycles << endl;
+            metricsOut << "#Issue width -> " << Width << endl;
+            metricsOut << "#Functional units ALU/branch/memory -> " << units.count[FU_ALU] << "/" << units.count[FU_BRANCH] << "/" << units.count[FU_MEMORY] << endl;
+            metricsOut << "#Intra-bundle dependency stall cycles -> " << intraBundleStalls << endl;
+            metricsOut << "#Structural stall cycles ALU/branch/memory -> " << structuralStalls[FU_ALU] << "/" << structuralStalls[FU_BRANCH] << "/" << structuralStalls[FU_MEMORY] << endl;
+            if (mixMulDiv > 0)
+            {
+                metricsOut << "#Multiply/divide instructions -> " << mixMulDiv << endl;
+                metricsOut << "#Multiply/divide result stall cycles -> " << scoreboardStalls << endl;
+                metricsOut << "#Busy multiplier/divider stall cycles -> " << mulDivStalls << endl;
+            }
+            for (int k = 0; k <= Width; k++)
+                metricsOut << "#Cycles issuing " << k << " -> " << issueHistogram[k] << endl;
+
+            metricsOut.close();
+            outputCounters(counterPath, coreName(), totalInstructions);
+        }
+        else
+        {
+            console() << "Unable to open performance metrics output file." << endl;
+        }
+    }
+
+private:
+    WideState<Width> stateBuffers[2]; // bundles instead of ScalarCore's latches
+    WideState<Width> *state = &stateBuffers[0];
+    WideState<Width> *nextState = &stateBuffers[1];
+
+    static stateStruct slotZero(const WideState<Width> &s) // what the FS state trace shows
+    {
+        stateStruct view;
+        view.IF = s.IF;
+        view.ID = s.ID[0];
+        view.EX = s.EX[0];
+        view.MEM = s.MEM[0];
+        view.WB = s.WB[0];
+        return view;
+    }
+
+    bool pipelineEmpty() const
+    {
+        if (!state->IF.nop)
+            return false;
+        for (int i = 0; i < Width; i++)
+            if (!state->ID[i].nop || !state->EX[i].nop || !state->MEM[i].nop || !state->WB[i].nop)
+                return false;
+        return true;
+    }
+
+    static int unitOf(const MicroOp &uop)
+    {
+        switch (uop.opClass)
+        {
+        case OPC_RTYPE:
+        case OPC_ITYPE:
+        case OPC_LUI:
+        case OPC_AUIPC:
+            return FU_ALU;
+        case OPC_BRANCH:
+        case OPC_JAL:
+        case OPC_JALR:
+            return FU_BRANCH;
+        case OPC_LOAD:
+        case OPC_STORE:
+            return FU_MEMORY;
+        default: // the multiplier and divider are tracked by mulDiv
+            return FU_COUNT;
+        }
+    }
+
+    bool loadInEX(const MicroOp &uop) const // a source is written by a load that only reaches MEM next cycle
+    {
+        for (int i = 0; i < Width; i++)
+        {
+            const EXStruct &ex = state->EX[i];
+            if (!ex.nop && ex.rd_mem && ex.rd != 0 && (ex.rd == uop.rs1 || ex.rd == uop.rs2))
+                return true;
+        }
+        return false;
+    }
+
+    bool resultInFlight(const MicroOp &uop) const // a source is written by an instruction in EX or MEM
+    {
+        for (int i = 0; i < Width; i++)
+            if (FiveStageCore::writesSource(state->EX[i], uop) || FiveStageCore::writesSource(state->MEM[i], uop))
+                return true;
+        return false;
+    }
+
+    bool dependsOnIssued(const MicroOp &uop, int issued) const // RAW on an instruction issued this cycle
+    {
+        for (int i = 0; i < issued; i++)
+        {
+            const EXStruct &older = nextState->EX[i];
+            if (older.wrt_enable && older.rd != 0 && (older.rd == uop.rs1 || older.rd == uop.rs2))
+                return true;
+        }
+        return false;
+    }
+
+    // Value of `reg` for an instruction in EX: the youngest writer in the EX/MEM bundle, then
+    // in the MEM/WB bundle, else what ID read. Loads in EX/MEM are skipped like in the scalar
+    // core, ID never lets their consumers through.
+    uint32_t forwardOperand(uint8_t reg, uint32_t readValue)
+    {
+        if (reg == 0)
+            return readValue;
+        for (int i = Width - 1; i >= 0; i--)
+        {
+            const MEMStruct &mem = state->MEM[i];
+            if (!mem.nop && mem.wrt_enable && mem.rd == reg)
+            {
+                if (mem.rd_mem)
+                    break;
+                forwardsFromMEM++;
+                return mem.ALUresult;
+            }
+        }
+        for (int i = Width - 1; i >= 0; i--)
+        {
+            const WBStruct &wb = state->WB[i];
+            if (!wb.nop && wb.wrt_enable && wb.rd == reg)
+            {
+                forwardsFromWB++;
+                return wb.Wrt_data;
+            }
+        }
+        return readValue;
+    }
+
+    uint32_t predictNextPC(uint32_t PC)
+    {
+        uint32_t target;
+        bool conditional;
+        if (btb.lookup(PC, target, conditional) && (!conditional || predictor->predict(PC)))
+            return target;
+        return PC + 4;
+    }
+
+    string perfFilePath;
+    string counterPath;
+    int totalInstructions = 0;
+    bool halt = false;
+    unique_ptr<BranchPredictor> predictor = makeBranchPredictor("static");
+    BranchTargetBuffer btb;
+    FunctionalUnits units;
+    uint64_t loadUseStalls = 0;
+    uint64_t rawStalls = 0;
+    uint64_t intraBundleStalls = 0;
+    uint64_t structuralStalls[FU_COUNT] = {};
+    uint64_t issueHistogram[Width + 1] = {};
+    uint64_t forwardsFromMEM = 0;
+    uint64_t forwardsFromWB = 0;
+    uint64_t branches = 0;
+    uint64_t branchMispredicts = 0;
+    uint64_t takenBranches = 0;
+    uint64_t jumps = 0;
+    uint64_t jumpMispredicts = 0;
+    uint64_t flushCycles = 0;
+    uint64_t mixRType = 0;
+    uint64_t mixIType = 0;
+    uint64_t mixLoads = 0;
+    uint64_t mixStores = 0;
+    uint64_t mixMulDiv = 0;
+    MulDivUnits mulDiv;
+    Scoreboard scoreboard;
+    uint64_t scoreboardStalls = 0;
+    uint64_t mulDivStalls = 0;
+    bool forwarding = true;
+};
+
+// Functional warm-up: run the single-stage core untraced on the same memories,
+// then hand PC and registers to the timing core (DataMem is already shared)
+void fastForwardCore(Core &target, const string &ioDir, InsMem &imem, DataMem &dmem, long long instructions)
+{
+    SingleStageCore FFCore(ioDir, imem, dmem, TRACE_OFF);
+    if (instructions > 0)
+        FFCore.run(instructions);
+
+    target.loadArchState(FFCore.state->IF.PC, FFCore.myRF);
+    console() << "Fast-forwarded " << FFCore.instructionCount() << " instructions, timing model starts at PC " << FFCore.state->IF.PC << endl;
+}
+
+// Golden reference for --cosim, run on its own thread: replays the program on a private
+// single-stage core and checks every instruction the core under test retires, in order.
+// Returns false at the first divergence, which is reported straight away.
+bool cosimReference(const string &ioDir, long long skipInstructions, CommitStream &commits)
+{
+    InsMem imem = InsMem("Imem", ioDir);
+    DataMem dmem = DataMem("REF", ioDir);
+    SingleStageCore ref(ioDir, imem, dmem, TRACE_OFF);
+    if (skipInstructions > 0) // matches the fast-forwarded prefix
+        ref.run(skipInstructions);
+
+    CommitRecord got;
+    uint64_t checked = 0;
+    while (commits.pop(got))
+    {
+        ref.step();
+        if (ref.halted || !sameCommit(ref.lastCommit, got))
+        {
+            console() << "Co-simulation divergence at retired instruction " << checked << endl;
+            console() << "  five-stage: ";
+            formatCommit(console(), got);
+            console() << endl
+                      << "  reference:  ";
+            if (ref.halted)
+                console() << "halted at PC " << ref.state->IF.PC;
+            else
+                formatCommit(console(), ref.lastCommit);
+            console() << endl;
+            commits.stop();
+            return false;
+        }
+        checked++;
+    }
+
+    ref.step(); // the core under test halted, so the reference should be at its halt too
+    if (!ref.halted)
+    {
+        console() << "Co-simulation divergence: five-stage core halted after " << checked
+                  << " instructions, reference continues at PC " << ref.lastCommit.PC << endl;
+        return false;
+    }
+    console() << "Co-simulation passed, " << checked << " retired instructions matched." << endl;
+    return true;
+}
+
+// Batch job on the superscalar core (--batch with --width), same outputs as runWide
+template <int Width>
+void runWideJob(const BatchJob &job, InsMem &imem, TraceMode traceMode, long long fastForward, const string &branchPredictor,
+                const FunctionalUnits &units, const MulDivSetup &mulDivSetup, bool forwarding, BatchResult &result)
+{
+    DataMem dmem = DataMem(SuperscalarCore<Width>::coreName(), job.inputDir, job.outputDir);
+    SuperscalarCore<Width> core(job.outputDir, imem, dmem, traceMode);
+    core.setBranchPredictor(makeBranchPredictor(branchPredictor));
+    core.setFunctionalUnits(units);
+    core.setMulDiv(mulDivSetup);
+    core.setForwarding(forwarding);
+    if (fastForward > 0)
+        fastForwardCore(core, job.inputDir, imem, dmem, fastForward);
+
+    while (!core.halted)
+        core.step();
+
+    dmem.outputDataMem();
+    core.outputPerformanceMetrics();
+    core.outputEvents();
+
+    result.cycles = core.cycle;
+    result.instructions = core.instructionCount();
+    result.ok = true;
+}
+
+// One batch job, run entirely on the calling worker thread: private memories and core,
+// outputs in job.outputDir and console messages in <outputDir>/FS_Console.txt.
+// width 0 runs the five-stage core, otherwise the superscalar core of that width.
+BatchResult runBatchJob(const BatchJob &job, TraceMode traceMode, long long fastForward, const string &branchPredictor, const CacheSetup &cacheSetup, const MulDivSetup &mulDivSetup,
+                        bool profile, bool idleSkip, bool forwarding, int width, const FunctionalUnits &units)
+{
+    BatchResult result;
+    error_code ec;
+    filesystem::create_directories(job.outputDir, ec);
+
+    ofstream log(joinPath(job.outputDir, "FS_Console.txt"), std::ios_base::trunc);
+    if (!log.is_open())
+        return result;
+    simConsole = &log;
+
+    InsMem imem = InsMem("Imem", job.inputDir);
+    if (imem.loaded && width != 0) // main() has checked it is 1, 2 or 4
+    {
+        switch (width)
+        {
+        case 1:
+            runWideJob<1>(job, imem, traceMode, fastForward, branchPredictor, units, mulDivSetup, forwarding, result);
+            break;
+        case 2:
+            runWideJob<2>(job, imem, traceMode, fastForward, branchPredictor, units, mulDivSetup, forwarding, result);
+            break;
+        case 4:
+            runWideJob<4>(job, imem, traceMode, fastForward, branchPredictor, units, mulDivSetup, forwarding, result);
+            break;
+        }
+    }
+    else if (imem.loaded) // without an image the core would fetch zeros forever
+    {
+        DataMem dmem_fs = DataMem("FS", job.inputDir, job.outputDir);
+        FiveStageCore FSCore(job.outputDir, imem, dmem_fs, traceMode);
+        FSCore.setBranchPredictor(makeBranchPredictor(branchPredictor));
+        FSCore.setCaches(cacheSetup);
+        FSCore.setMulDiv(mulDivSetup);
+
+        if (fastForward > 0)
+            fastForwardCore(FSCore, job.inputDir, imem, dmem_fs, fastForward);
+        if (profile)
+            FSCore.enableProfiler();
+        FSCore.setIdleSkip(idleSkip);
+        FSCore.setForwarding(forwarding);
+
+        FSCore.run();
+
+        dmem_fs.outputDataMem();
+        FSCore.outputPerformanceMetrics();
+        FSCore.outputEvents();
+
+        result.cycles = FSCore.cycle;
+        result.instructions = FSCore.instructionCount();
+        result.ok = true;
+    } // core (and its trace writer) is flushed before the log goes away
+
+    simConsole = &cout;
+    return result;
+}
+
+// --width run: the superscalar core on its own memories, with the options it models
+template <int Width>
+int runWide(const string &ioDir, TraceMode traceMode, long long fastForward, const string &branchPredictor, const FunctionalUnits &units, const MulDivSetup &mulDivSetup, bool forwarding, bool cosim)
+{
+    InsMem imem = InsMem("Imem", ioDir);
+    DataMem dmem = DataMem(SuperscalarCore<Width>::coreName(), ioDir);
+    SuperscalarCore<Width> core(ioDir, imem, dmem, traceMode);
+    core.setBranchPredictor(makeBranchPredictor(branchPredictor));
+    core.setFunctionalUnits(units);
+    core.setMulDiv(mulDivSetup);
+    core.setForwarding(forwarding);
+    if (fastForward > 0)
+        fastForwardCore(core, ioDir, imem, dmem, fastForward);
+
+    CommitStream commits;
+    bool cosimPassed = true;
+    thread reference;
+    if (cosim)
+    {
+        core.commitLog = &commits;
+        reference = thread([&]
+                           { cosimPassed = cosimReference(ioDir, fastForward, commits); });
+    }
+
+    while (!core.halted && !commits.diverged())
+        core.step();
+
+    if (cosim)
+    {
+        commits.finish();
+        reference.join();
+    }
+
+    dmem.outputDataMem();
+    core.outputPerformanceMetrics();
+    core.outputEvents();
+    return cosimPassed && core.trapCause != TRAP_ILLEGAL_INSTRUCTION ? 0 : 1;
+}
+
+// --cores run: that many five-stage cores, each on its own host thread with a private
+// InsMem (its decode cache is not thread-safe) and private caches, sharing one DataMem.
+// The L1Ds are kept coherent by a snooping bus. Core i starts with its hart id i in a0.
+// Cores run `quantum` cycles at a time and then wait for each other, so no core gets more
+// than a quantum ahead of the slowest one. Within a quantum, accesses to the bus and to
+// DataMem take turns by (cycle, core id) (see AccessOrder), so results are repeatable.
+int runMultiCore(const string &ioDir, int coreCount, TraceMode traceMode, const string &branchPredictor, const CacheSetup &cacheSetup,
+                 CoherenceProtocol protocol, uint32_t busLatency, uint32_t quantum, bool profile, bool idleSkip, bool forwarding, const MulDivSetup &mulDivSetup)
+{
+    DataMem dmem = DataMem("MC", ioDir);
+    dmem.shareBetweenThreads();
+    CoherenceBus bus(protocol, busLatency);
+    AccessOrder order(coreCount);
+
+    vector<unique_ptr<InsMem>> imems;
+    vector<unique_ptr<FiveStageCore>> cores;
+    for (int i = 0; i < coreCount; i++)
+    {
+        imems.emplace_back(new InsMem("Imem", ioDir));
+        cores.emplace_back(new FiveStageCore(ioDir, *imems[i], dmem, traceMode, "FS" + to_string(i)));
+        FiveStageCore &core = *cores[i];
+        core.setBranchPredictor(makeBranchPredictor(branchPredictor));
+        core.setCaches(cacheSetup);
+        core.joinBus(bus, order, i);
+        core.setIdleSkip(idleSkip);
+        core.setForwarding(forwarding);
+        core.setMulDiv(mulDivSetup);
+        core.myRF.writeRF(10, i); // a0 = hart id
+        if (profile)
+            core.enableProfiler();
+    }
+
+    QuantumBarrier barrier(coreCount);
+    vector<thread> threads;
+    for (int i = 0; i < coreCount; i++)
+        threads.emplace_back([&, i]
+                             {
+                                 FiveStageCore &core = *cores[i];
+                                 for (uint64_t end = quantum;; end += quantum)
+                                 {
+                                     core.setSkipHorizon(end);
+                                     core.run(end);
+                                     if (core.halted)
+                                         order.finish(i);
+                                     else
+                                         order.publish(i, core.cycle);
+                                     if (barrier.arrive(core.halted))
+                                         break;
+                                 } });
+    for (thread &t : threads)
+        t.join();
+
+    dmem.outputDataMem();
+    uint64_t cycles = 0, instructions = 0;
+    for (int i = 0; i < coreCount; i++)
+    {
+        cores[i]->outputPerformanceMetrics();
+        cores[i]->outputEvents();
+        console() << "Core " << i << ": " << cores[i]->instructionCount() << " instructions in " << cores[i]->cycle << " cycles" << endl;
+        cycles = max<uint64_t>(cycles, cores[i]->cycle);
+        instructions += cores[i]->instructionCount();
+    }
+    bus.outputMetrics(joinPath(ioDir, "PerformanceMetrics_Bus"), cycles, instructions);
+    for (auto &core : cores)
+        if (core->trapCause == TRAP_ILLEGAL_INSTRUCTION)
+            return 1;
+    return 0;
+}
+
+template <typename T>
+bool parseCount(const string &text, T &value) // a whole non-negative decimal number that fits in T, e.g. "--jobs 4"
+{
+    long long number;
+    size_t used;
+    try
+    {
+        number = stoll(text, &used);
+    }
+    catch (const exception &)
+    {
+        return false;
+    }
+    if (used != text.size() || number < 0 || static_cast<unsigned long long>(number) > static_cast<unsigned long long>(numeric_limits<T>::max()))
+        return false;
+    value = static_cast<T>(number);
+    return true;
+}
+
+#ifndef SIM_NO_MAIN // bench.cpp includes this file for the cores and supplies its own main
+int main(int argc, char *argv[])
+{
+    string ioDir = "";
+    TraceMode traceMode = TRACE_TEXT;
+    long long fastForward = 0; // instructions to run on the functional core before the timing model takes over
+    long long checkpointAt = -1; // cycle at which to write checkpointOut
+    string checkpointOut = "checkpoint.bin";
+    string restoreFrom = "";     // checkpoint to resume from instead of reset
+    bool cosim = false;          // check every retired instruction against the single-stage core
+    string branchPredictor = "static";
+    CacheSetup cacheSetup;       // all levels absent unless --l1i/--l1d/--l2 are given
+    bool profile = false;        // per-PC profile in FS_Profile.folded / FS_Profile.txt
+    bool idleSkip = true;        // jump over cycles in which the stalled pipeline cannot change
+    bool forwarding = true;      // --no-forwarding: ID waits for results to reach the register file
+    MulDivSetup mulDivSetup;     // multiplier and divider timing, --mul and --div
+    int width = 0;               // --width: run the superscalar core with this issue width instead
+    FunctionalUnits units;       // its functional units, --fu
+    int coreCount = 0;           // --cores: five-stage cores sharing DataMem through coherent L1Ds, 0 = no bus
+    CoherenceProtocol protocol = PROTOCOL_MESI;
+    uint32_t busLatency = 4;     // cycles one coherence bus transfer occupies the bus
+    uint32_t quantum = 10;       // cycles the cores run between two synchronisations
+    bool busOptions = false;     // one of the three above was given, they need --cores
+    string batchManifest = "";   // run every workload listed here instead of a single --iodir
+    string batchCsv = "BatchResults.csv";
+    unsigned jobs = thread::hardware_concurrency();
+    bool haveIoDir = false;
+
+    // Command-line argument handling
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--iodir" && i + 1 < argc)
+        {
+            ioDir = argv[++i];
+            haveIoDir = true;
+            cout << "IO Directory: " << ioDir << endl;
+        }
+        else if (arg == "--trace" && i + 1 < argc && parseTraceMode(argv[i + 1], traceMode))
+        {
+            i++;
+        }
+        else if (arg == "--fastforward" && i + 1 < argc && parseCount(argv[i + 1], fastForward))
+        {
+            i++;
+        }
+        else if (arg == "--checkpoint-at" && i + 1 < argc && parseCount(argv[i + 1], checkpointAt))
+        {
+            i++;
+        }
+        else if (arg == "--checkpoint-out" && i + 1 < argc)
+        {
+            checkpointOut = argv[++i];
+        }
+        else if (arg == "--restore" && i + 1 < argc)
+        {
+            restoreFrom = argv[++i];
+        }
+        else if (arg == "--cosim")
+        {
+            cosim = true;
+        }
+        else if (arg == "--bp" && i + 1 < argc && makeBranchPredictor(argv[i + 1]))
+        {
+            branchPredictor = argv[++i];
+        }
+        else if (arg == "--l1i" && i + 1 < argc && parseCacheConfig(argv[i + 1], cacheSetup.l1i))
+        {
+            i++;
+        }
+        else if (arg == "--l1d" && i + 1 < argc && parseCacheConfig(argv[i + 1], cacheSetup.l1d))
+        {
+            i++;
+        }
+        else if (arg == "--l2" && i + 1 < argc && parseCacheConfig(argv[i + 1], cacheSetup.l2))
+        {
+            i++;
+        }
+        else if (arg == "--mem-latency" && i + 1 < argc && parseCount(argv[i + 1], cacheSetup.memoryLatency))
+        {
+            i++;
+        }
+        else if (arg == "--no-idle-skip")
+        {
+            idleSkip = false;
+        }
+        else if (arg == "--no-forwarding")
+        {
+            forwarding = false;
+        }
+        else if (arg == "--mul" && i + 1 < argc && parseExecUnitConfig(argv[i + 1], mulDivSetup.mul))
+        {
+            i++;
+        }
+        else if (arg == "--div" && i + 1 < argc && parseExecUnitConfig(argv[i + 1], mulDivSetup.div))
+        {
+            i++;
+        }
+        else if (arg == "--width" && i + 1 < argc)
+        {
+            if (!parseCount(argv[++i], width) || width == 0)
+                width = -1; // rejected below with the other widths
+        }
+        else if (arg == "--fu" && i + 1 < argc && parseFunctionalUnits(argv[i + 1], units))
+        {
+            i++;
+        }
+        else if (arg == "--cores" && i + 1 < argc && parseCount(argv[i + 1], coreCount) && coreCount >= 1)
+        {
+            i++;
+        }
+        else if (arg == "--coherence" && i + 1 < argc && parseCoherenceProtocol(argv[i + 1], protocol))
+        {
+            i++;
+            busOptions = true;
+        }
+        else if (arg == "--bus-latency" && i + 1 < argc && parseCount(argv[i + 1], busLatency))
+        {
+            i++;
+            busOptions = true;
+        }
+        else if (arg == "--quantum" && i + 1 < argc && parseCount(argv[i + 1], quantum))
+        {
+            i++;
+            busOptions = true;
+        }
+        else if (arg == "--profile")
+        {
+            profile = true;
+        }
+        else if (arg == "--batch" && i + 1 < argc)
+        {
+            batchManifest = argv[++i];
+        }
+        else if (arg == "--jobs" && i + 1 < argc && parseCount(argv[i + 1], jobs))
+        {
+            i++;
+        }
+        else if (arg == "--csv" && i + 1 < argc)
+        {
+            batchCsv = argv[++i];
+        }
+        else
+        {
+            cout << "Invalid arguments. Usage: ./main --iodir <path_to_directory> [--trace text|binary|off] [--fastforward <instructions>]"
+                 << " [--checkpoint-at <cycle> [--checkpoint-out <file>]] [--restore <file>] [--cosim] [--bp static|bimodal|gshare] [--profile] [--no-idle-skip] [--no-forwarding]"
+                 << " [--mul|--div <latency>[,pipelined|iterative]]"
+                 << " [--width 1|2|4 [--fu <alu>,<branch>,<memory>]]"
+                 << " [--cores <n> --l1d <...,wb> [--coherence msi|mesi] [--bus-latency <cycles>] [--quantum <cycles>]]"
+                 << " [--l1i|--l1d|--l2 <size>,<ways>,<line>[,lru|plru|random][,wb|wt][,<hit latency>]] [--mem-latency <cycles>]" << endl;
+            cout << "       ./main --batch <manifest> [--jobs <threads>] [--csv <file>] [--trace text|binary|off] [--fastforward <instructions>] [--bp <predictor>] [--profile] [--no-idle-skip] [--no-forwarding] [--width 1|2|4 [--fu ...]] [cache and --mul/--div options]" << endl;
+            return -1;
+        }
+    }
+
+    if (busOptions && coreCount == 0)
+    {
+        cout << "--coherence, --bus-latency and --quantum need --cores." << endl;
+        return -1;
+    }
+
+    if (width != 0)
+    {
+        if (width != 1 && width != 2 && width != 4)
+        {
+            cout << "--width must be 1, 2 or 4." << endl;
+            return -1;
+        }
+        if (!restoreFrom.empty() || checkpointAt >= 0 || profile || cacheSetup.l1i.size || cacheSetup.l1d.size || cacheSetup.l2.size)
+        {
+            cout << "--width does not model caches, profiles or checkpoints." << endl;
+            return -1;
+        }
+    }
+
+    if (!batchManifest.empty())
+    {
+        if (cosim || !restoreFrom.empty() || checkpointAt >= 0 || coreCount != 0)
+        {
+            cout << "--batch does not combine with --cosim, --restore, --checkpoint-at or --cores." << endl;
+            return -1;
+        }
+        vector<BatchJob> batch;
+        if (!readManifest(batchManifest, batch))
+        {
+            cout << "Unable to open batch manifest " << batchManifest << endl;
+            return -1;
+        }
+
+        vector<BatchResult> results(batch.size());
+        runWorkStealing(batch.size(), jobs == 0 ? 1 : jobs, [&](size_t j)
+                        { results[j] = runBatchJob(batch[j], traceMode, fastForward, branchPredictor, cacheSetup, mulDivSetup, profile, idleSkip, forwarding, width, units); });
+
+        if (!writeBatchCsv(batchCsv, batch, results))
+        {
+            cout << "Unable to open " << batchCsv << " for writing." << endl;
+            return -1;
+        }
+        size_t failed = count_if(results.begin(), results.end(), [](const BatchResult &r)
+                                 { return !r.ok; });
+        cout << "Ran " << batch.size() << " workloads, " << failed << " failed. Results in " << batchCsv << endl;
+        return failed == 0 ? 0 : 1;
+    }
+
+    if (!haveIoDir)
+    {
+        cout << "Enter path containing the memory files: ";
+        cin >> ioDir;
+    }
+
+    if (coreCount != 0) // even one core gets its L1D on the bus, so the bus options and metrics apply
+    {
+        if (!restoreFrom.empty() || checkpointAt >= 0 || cosim || fastForward > 0 || width != 0)
+        {
+            cout << "--cores does not combine with checkpoints, --cosim, --fastforward or --width." << endl;
+            return -1;
+        }
+        if (cacheSetup.l1d.size == 0 || cacheSetup.l1d.writePolicy != WRITE_BACK || quantum == 0)
+        {
+            cout << "--cores needs a write-back --l1d for the coherence bus, and a non-zero --quantum." << endl;
+            return -1;
+        }
+        return runMultiCore(ioDir, coreCount, traceMode, branchPredictor, cacheSetup, protocol, busLatency, quantum, profile, idleSkip, forwarding, mulDivSetup);
+    }
+
+    switch (width) // 0: the five-stage core below
+    {
+    case 1:
+        return runWide<1>(ioDir, traceMode, fastForward, branchPredictor, units, mulDivSetup, forwarding, cosim);
+    case 2:
+        return runWide<2>(ioDir, traceMode, fastForward, branchPredictor, units, mulDivSetup, forwarding, cosim);
+    case 4:
+        return runWide<4>(ioDir, traceMode, fastForward, branchPredictor, units, mulDivSetup, forwarding, cosim);
+    }
+
+    InsMem imem = InsMem("Imem", ioDir);
+    // DataMem dmem_ss = DataMem("SS", ioDir);
+    DataMem dmem_fs = DataMem("FS", ioDir);
+
+    // SingleStageCore SSCore(ioDir, imem, dmem_ss);
+    FiveStageCore FSCore(ioDir, imem, dmem_fs, traceMode);
+    FSCore.setBranchPredictor(makeBranchPredictor(branchPredictor));
+    FSCore.setCaches(cacheSetup);
+    FSCore.setMulDiv(mulDivSetup);
+
+    if (!restoreFrom.empty())
+    {
+        if (!FSCore.restoreCheckpoint(restoreFrom))
+            return -1;
+        cout << "Restored checkpoint " << restoreFrom << " at cycle " << FSCore.cycle << endl;
+    }
+    else if (fastForward > 0)
+    {
+        fastForwardCore(FSCore, ioDir, imem, dmem_fs, fastForward);
+    }
+
+    if (profile)
+        FSCore.enableProfiler();
+    FSCore.setIdleSkip(idleSkip);
+    FSCore.setForwarding(forwarding);
+    if (checkpointAt >= 0)
+        FSCore.setSkipHorizon(checkpointAt);
+
+    CommitStream commits;
+    bool cosimPassed = true;
+    thread reference;
+    if (cosim)
+    {
+        if (!restoreFrom.empty())
+        {
+            cout << "--cosim cannot start from a checkpoint, the reference core always starts from reset." << endl;
+            return -1;
+        }
+        FSCore.commitLog = &commits;
+        reference = thread([&]
+                           { cosimPassed = cosimReference(ioDir, fastForward, commits); });
+    }
+
+    if (checkpointAt >= 0)
+    {
+        FSCore.run(checkpointAt);
+        if (!FSCore.halted && !commits.diverged() && FSCore.cycle == checkpointAt && FSCore.saveCheckpoint(checkpointOut))
+            cout << "Checkpoint written to " << checkpointOut << " at cycle " << FSCore.cycle << endl;
+    }
+    FSCore.run();
+
+    if (cosim)
+    {
+        commits.finish();
+        reference.join();
+    }
+
+    dmem_fs.outputDataMem();
+
+    FSCore.outputPerformanceMetrics();
+    FSCore.outputEvents();
+
+    // Use outputDataMem to output data memory
+    // SSCore.getDataMem().outputDataMem();
+
+    // SSCore.outputPerformanceMetrics();
+
+    return cosimPassed && FSCore.trapCause != TRAP_ILLEGAL_INSTRUCTION ? 0 : 1; // ECALL and EBREAK end a run normally
 }
+#endif
@@ -0,0 +1,90 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cstdint>
+
+// Pipeline latches. Fields are native integers so the stages never round-trip
+// through bitset, and each latch only carries one already resolved immediate.
+struct IFStruct
+{
+    uint32_t PC = 0;
+    bool nop = false;
+};
+
+struct IDStruct
+{
+    uint32_t PC = 0; // address of Instr, used to look it up in the decode cache
+    uint32_t Instr = 0;
+    uint32_t Next_PC = 0; // where IF went after this instruction (the prediction), checked in EX
+    bool nop = true;
+};
+
+struct EXStruct
+{
+    uint32_t PC = 0; // carried down to WB so retired instructions can be identified
+    uint32_t Next_PC = 0;
+    uint32_t Read_data1 = 0;
+    uint32_t Read_data2 = 0;
+    int32_t Imm = 0; // sign-extended immediate for the instruction's format
+    uint32_t Instr = 0;
+    uint8_t rs1 = 0;
+    uint8_t rs2 = 0;
+    uint8_t rd = 0;
+    uint8_t func3 = 0;
+    uint8_t func7 = 0;
+    bool rd_mem = false;
+    bool wrt_mem = false;
+    bool alu_op = false;
+    bool wrt_enable = false;
+    bool nop = true;
+    bool is_I_type = false;
+};
+
+struct MEMStruct
+{
+    uint32_t PC = 0;
+    uint32_t ALUresult = 0;
+    uint32_t Store_data = 0;
+    uint8_t rs1 = 0;
+    uint8_t rs2 = 0;
+    uint8_t rd = 0;
+    bool rd_mem = false;
+    bool wrt_mem = false;
+    bool wrt_enable = false;
+    bool nop = true;
+};
+
+struct WBStruct
+{
+    uint32_t PC = 0;
+    uint32_t Wrt_data = 0;
+    uint32_t Store_addr = 0; // memory write done in MEM, kept for the commit record
+    uint32_t Store_data = 0;
+    uint8_t rs1 = 0;
+    uint8_t rs2 = 0;
+    uint8_t rd = 0;
+    bool wrt_mem = false;
+    bool wrt_enable = false;
+    bool nop = true;
+};
+
+struct alignas(64) stateStruct // whole pipeline state, kept on cache-line boundaries
+{
+    IFStruct IF;
+    IDStruct ID;
+    EXStruct EX;
+    MEMStruct MEM;
+    WBStruct WB;
+};
+
+template <int Width>
+struct alignas(64) WideState // SuperscalarCore: one latch per issue slot, slot 0 holds the oldest instruction
+{
+    IFStruct IF;
+    IDStruct ID[Width];
+    EXStruct EX[Width];
+    MEMStruct MEM[Width];
+    WBStruct WB[Width];
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+// Per-PC hotspot profile of the guest program. Counts live in flat arrays indexed by
+// PC >> 2 that grow to the highest PC seen, so recording is an index and an add.
+//
+// Call stacks are rebuilt from retired instructions: a JAL or JALR that links (rd != 0)
+// enters a function at its target, and retiring the instruction at a frame's return address
+// (PC + 4 of the call) leaves that frame and everything called from it. Frames are
+// interned in a tree, each node counting the cost spent while it was the innermost one.
+
+class PcProfiler
+{
+public:
+    PcProfiler(uint32_t entryPC)
+    {
+        nodes.push_back({entryPC, 0, 0, 0});
+    }
+
+    void retire(uint32_t PC) // WB, in program order
+    {
+        if (indirectCallPending) // PC is the target of the JALR that retired just before
+        {
+            indirectCallPending = false;
+            call(indirectCallPC, PC);
+        }
+        while (current != 0 && PC == nodes[current].returnPC) // back in the caller
+            current = nodes[current].parent;
+        slot(PC).retired++;
+        nodes[current].cost++;
+    }
+
+    void call(uint32_t PC, uint32_t target) // the linking JAL at PC just retired
+    {
+        map<uint32_t, uint32_t> &children = nodeChildren(current);
+        auto it = children.find(target);
+        uint32_t child;
+        if (it == children.end())
+        {
+            child = nodes.size();
+            nodes.push_back({target, current, PC + 4, 0});
+            children[target] = child;
+        }
+        else
+        {
+            child = it->second;
+            nodes[child].returnPC = PC + 4;
+        }
+        current = child;
+    }
+
+    void indirectCall(uint32_t PC) // the linking JALR at PC just retired, its target is not known here
+    {
+        indirectCallPC = PC;
+        indirectCallPending = true;
+    }
+
+    void stall(uint32_t PC, uint64_t cycles = 1) // cycles lost by the instruction at PC
+    {
+        slot(PC).stalls += cycles;
+        nodes[current].cost += cycles;
+    }
+
+    void memoryAccess(uint32_t PC)
+    {
+        slot(PC).memAccesses++;
+    }
+
+    // Brendan Gregg's collapsed format, "frame;frame;frame weight" per line, weight = retired
+    // instructions + stall cycles. Stalls are charged to the stack of the youngest retired
+    // instruction, which can be a call or return behind the stalled one.
+    void writeCollapsed(ostream &out) const
+    {
+        for (uint32_t n = 0; n < nodes.size(); n++)
+        {
+            if (nodes[n].cost == 0)
+                continue;
+            vector<uint32_t> path;
+            for (uint32_t p = n;; p = nodes[p].parent)
+            {
+                path.push_back(nodes[p].function);
+                if (p == 0)
+                    break;
+            }
+            for (size_t i = path.size(); i-- > 0;)
+                out << frameName(path[i]) << (i ? ";" : " ");
+            out << nodes[n].cost << "\n";
+        }
+    }
+
+    // one row per PC that did anything, most expensive (retired + stalls) first
+    template <typename Disassemble>
+    void writeTable(ostream &out, Disassemble instructionAt) const
+    {
+        vector<uint32_t> used;
+        for (uint32_t i = 0; i < counts.size(); i++)
+            if (counts[i].retired || counts[i].stalls || counts[i].memAccesses)
+                used.push_back(i);
+        stable_sort(used.begin(), used.end(), [this](uint32_t a, uint32_t b)
+                    { return counts[a].retired + counts[a].stalls > counts[b].retired + counts[b].stalls; });
+
+        out << "PC          Instr       Retired     Stalls      MemAccesses" << endl;
+        for (uint32_t i : used)
+        {
+            const PcCounts &c = counts[i];
+            out << hex << setfill('0') << "0x" << setw(8) << (i << 2) << "  0x" << setw(8) << instructionAt(i << 2)
+                << dec << setfill(' ') << "  " << setw(10) << c.retired << "  " << setw(10) << c.stalls
+                << "  " << setw(10) << c.memAccesses << endl;
+        }
+    }
+
+private:
+    struct PcCounts
+    {
+        uint64_t retired = 0;
+        uint64_t stalls = 0;
+        uint64_t memAccesses = 0;
+    };
+
+    struct Node
+    {
+        uint32_t function; // entry PC
+        uint32_t parent;
+        uint32_t returnPC; // caller resumes here
+        uint64_t cost;
+    };
+
+    PcCounts &slot(uint32_t PC)
+    {
+        uint32_t index = PC >> 2;
+        if (index >= counts.size())
+            counts.resize(max<size_t>(index + 1, counts.size() * 2));
+        return counts[index];
+    }
+
+    map<uint32_t, uint32_t> &nodeChildren(uint32_t node) // function entry PC -> child node
+    {
+        if (node >= children.size())
+            children.resize(node + 1);
+        return children[node];
+    }
+
+    static string frameName(uint32_t function)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "fn_%08x", function);
+        return name;
+    }
+
+    vector<PcCounts> counts;
+    vector<Node> nodes; // node 0 is the program entry
+    vector<map<uint32_t, uint32_t>> children;
+    uint32_t current = 0;
+    uint32_t indirectCallPC = 0;
+    bool indirectCallPending = false;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef SCOREBOARD_H
+#define SCOREBOARD_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "type_SE.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+// Timing of the multi-cycle execution units (the RV32M multiplier and divider) and the
+// register scoreboard that follows their results. Like the caches these only model time:
+// the value is computed when the instruction passes EX and goes down the pipe as usual,
+// but no consumer may follow it into EX before the unit would have produced it.
+//
+// The scoreboard has one pending-write bit per register, so ID checks an instruction
+// against every multi-cycle result in flight with a single AND. A bit is set when the op
+// starts in EX and cleared in the cycle its consumer can leave ID; from then on the value
+// is forwarded or already in the register file. Destinations are checked as well: a
+// younger write to a register with a result still in flight has to wait, or the late
+// write would land on top of it.
+
+struct ExecUnitConfig
+{
+    uint32_t latency = 1;  // cycles from entering EX until a dependent instruction can be in EX
+    bool pipelined = true; // accepts an op every cycle, otherwise busy for `latency` cycles
+};
+
+struct MulDivSetup // --mul and --div
+{
+    ExecUnitConfig mul = {3, true};
+    ExecUnitConfig div = {20, false};
+};
+
+// "LATENCY[,pipelined|iterative]", e.g. "4" or "34,iterative"
+bool parseExecUnitConfig(const string &spec, ExecUnitConfig &config)
+{
+    vector<string> parts;
+    stringstream in(spec);
+    string part;
+    while (getline(in, part, ','))
+        parts.push_back(part);
+    if (parts.empty() || parts.size() > 2)
+        return false;
+
+    try
+    {
+        config.latency = stoul(parts[0]);
+    }
+    catch (const exception &)
+    {
+        return false;
+    }
+    if (parts.size() == 2)
+    {
+        if (parts[1] == "pipelined")
+            config.pipelined = true;
+        else if (parts[1] == "iterative")
+            config.pipelined = false;
+        else
+            return false;
+    }
+    return config.latency >= 1;
+}
+
+class ExecUnit
+{
+public:
+    ExecUnitConfig config;
+
+    bool accepts(uint64_t cycle) const // an op could enter EX in `cycle`
+    {
+        return config.pipelined || cycle >= busyUntil;
+    }
+
+    uint64_t start(uint64_t cycle) // an op enters EX in `cycle`; returns the first cycle a consumer can be in EX
+    {
+        busyUntil = cycle + config.latency;
+        return cycle + config.latency;
+    }
+
+    void save(ostream &out) const { putU64(out, busyUntil); }
+    void load(istream &in) { busyUntil = getU64(in); }
+
+private:
+    uint64_t busyUntil = 0; // an iterative unit is free again from this cycle on
+};
+
+class MulDivUnits // one multiplier for MUL/MULH*, one divider for DIV*/REM*
+{
+public:
+    ExecUnit mul;
+    ExecUnit div;
+
+    MulDivUnits() { configure(MulDivSetup()); }
+
+    void configure(const MulDivSetup &setup)
+    {
+        mul.config = setup.mul;
+        div.config = setup.div;
+    }
+
+    ExecUnit &unitFor(uint8_t op) { return op <= OP_MULHU ? mul : div; }
+    const ExecUnit &unitFor(uint8_t op) const { return op <= OP_MULHU ? mul : div; }
+
+    void save(ostream &out) const
+    {
+        mul.save(out);
+        div.save(out);
+    }
+
+    void load(istream &in)
+    {
+        mul.load(in);
+        div.load(in);
+    }
+};
+
+class Scoreboard
+{
+public:
+    uint32_t pending = 0; // bit r: a multi-cycle result for x[r] is still in flight
+
+    static uint32_t registersOf(const MicroOp &uop) // sources and destination, x0 excluded
+    {
+        return ((1u << uop.rs1) | (1u << uop.rs2) | (1u << uop.rd)) & ~1u;
+    }
+
+    bool blocks(const MicroOp &uop) const
+    {
+        return (pending & registersOf(uop)) != 0;
+    }
+
+    void reserve(uint8_t rd, uint64_t readyCycle) // readyCycle: first cycle a consumer can be in EX
+    {
+        if (rd == 0)
+            return;
+        pending |= 1u << rd;
+        release[rd] = readyCycle - 1; // it leaves ID the cycle before
+        if (release[rd] < nextRelease)
+            nextRelease = release[rd];
+    }
+
+    void advance(uint64_t cycle) // drop the results a consumer leaving ID in `cycle` can get
+    {
+        if (pending == 0 || cycle < nextRelease)
+            return;
+        nextRelease = UINT64_MAX;
+        for (int r = 1; r < 32; r++)
+        {
+            if (!(pending & (1u << r)))
+                continue;
+            if (release[r] <= cycle)
+                pending &= ~(1u << r);
+            else if (release[r] < nextRelease)
+                nextRelease = release[r];
+        }
+    }
+
+    void save(ostream &out) const
+    {
+        putU32(out, pending);
+        for (int r = 1; r < 32; r++)
+            if (pending & (1u << r))
+                putU64(out, release[r]);
+    }
+
+    void load(istream &in)
+    {
+        pending = getU32(in);
+        nextRelease = UINT64_MAX;
+        for (int r = 1; r < 32; r++)
+            if (pending & (1u << r))
+            {
+                release[r] = getU64(in);
+                if (release[r] < nextRelease)
+                    nextRelease = release[r];
+            }
+    }
+
+private:
+    uint64_t release[32] = {};          // cycle from which ID no longer waits for x[r]
+    uint64_t nextRelease = UINT64_MAX; // earliest of them, so most cycles return straight away
+};
+
+#endif
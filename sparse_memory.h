@@ -0,0 +1,201 @@
+#ifndef SPARSE_MEMORY_H
+#define SPARSE_MEMORY_H
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+// Full 32-bit address space backed by host pages that are only allocated when
+// first written. Reads of untouched memory return 0 without allocating.
+
+#define SIM_PAGE_BITS 12
+#define SIM_PAGE_SIZE (1u << SIM_PAGE_BITS)
+#define SIM_PAGE_MASK (SIM_PAGE_SIZE - 1)
+
+// Two-level table from a 20-bit page number to a lazily created Page, with the
+// most recently used page cached in front of the walk.
+template <typename Page>
+class PageMap
+{
+public:
+    PageMap() : directory(1024) {}
+
+    PageMap(const PageMap &other) : directory(1024)
+    {
+        other.forEachPage([this](uint32_t pageNumber, const Page &page)
+                          { *get(pageNumber, true) = page; });
+    }
+
+    PageMap &operator=(const PageMap &other)
+    {
+        if (this != &other)
+        {
+            directory.clear();
+            directory.resize(1024);
+            lastNumber = ~0u;
+            lastPage = nullptr;
+            other.forEachPage([this](uint32_t pageNumber, const Page &page)
+                              { *get(pageNumber, true) = page; });
+        }
+        return *this;
+    }
+
+    Page *get(uint32_t pageNumber, bool allocate) // nullptr if the page was never touched and allocate is false
+    {
+        if (pageNumber == lastNumber) // fast path, same page as the last access
+            return lastPage;
+
+        unique_ptr<Table> &table = directory[pageNumber >> 10];
+        if (!table)
+        {
+            if (!allocate)
+                return nullptr;
+            table.reset(new Table());
+        }
+        unique_ptr<Page> &page = (*table)[pageNumber & 0x3FF];
+        if (!page)
+        {
+            if (!allocate)
+                return nullptr;
+            page.reset(new Page());
+        }
+
+        lastNumber = pageNumber;
+        lastPage = page.get();
+        return lastPage;
+    }
+
+    template <typename F>
+    void forEachPage(F visit) const // visits allocated pages in address order
+    {
+        for (uint32_t hi = 0; hi < directory.size(); hi++)
+        {
+            if (!directory[hi])
+                continue;
+            for (uint32_t lo = 0; lo < 1024; lo++)
+            {
+                const unique_ptr<Page> &page = (*directory[hi])[lo];
+                if (page)
+                    visit((hi << 10) | lo, *page);
+            }
+        }
+    }
+
+    void clear()
+    {
+        directory.clear();
+        directory.resize(1024);
+        lastNumber = ~0u;
+        lastPage = nullptr;
+    }
+
+private:
+    typedef array<unique_ptr<Page>, 1024> Table;
+    vector<unique_ptr<Table>> directory;
+    uint32_t lastNumber = ~0u;
+    Page *lastPage = nullptr;
+};
+
+class SparseMemory
+{
+public:
+    typedef array<uint8_t, SIM_PAGE_SIZE> Page;
+
+    uint8_t readByte(uint32_t address)
+    {
+        Page *page = pages.get(address >> SIM_PAGE_BITS, false);
+        return page ? (*page)[address & SIM_PAGE_MASK] : 0;
+    }
+
+    void writeByte(uint32_t address, uint8_t value)
+    {
+        (*pages.get(address >> SIM_PAGE_BITS, true))[address & SIM_PAGE_MASK] = value;
+    }
+
+    // Multi-byte values are stored most significant byte first (same order as
+    // the imem/dmem images), the common case stays inside one page.
+    uint32_t read(uint32_t address, int bytes)
+    {
+        uint32_t offset = address & SIM_PAGE_MASK;
+        if (offset + bytes <= SIM_PAGE_SIZE)
+        {
+            Page *page = pages.get(address >> SIM_PAGE_BITS, false);
+            if (!page)
+                return 0;
+            const uint8_t *p = page->data() + offset;
+            switch (bytes)
+            {
+            case 4:
+                return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+            case 2:
+                return uint32_t(p[0]) << 8 | p[1];
+            default:
+                return p[0];
+            }
+        }
+
+        uint32_t value = 0; // straddles two pages
+        for (int i = 0; i < bytes; i++)
+            value = (value << 8) | readByte(address + i);
+        return value;
+    }
+
+    void write(uint32_t address, uint32_t value, int bytes)
+    {
+        uint32_t offset = address & SIM_PAGE_MASK;
+        if (offset + bytes <= SIM_PAGE_SIZE)
+        {
+            uint8_t *p = pages.get(address >> SIM_PAGE_BITS, true)->data() + offset;
+            for (int i = bytes - 1; i >= 0; i--)
+            {
+                p[i] = value & 0xFF;
+                value >>= 8;
+            }
+            return;
+        }
+
+        for (int i = bytes - 1; i >= 0; i--)
+        {
+            writeByte(address + i, value & 0xFF);
+            value >>= 8;
+        }
+    }
+
+    uint32_t readWord(uint32_t address) { return read(address, 4); }
+    void writeWord(uint32_t address, uint32_t value) { write(address, value, 4); }
+
+    void writeBlock(uint32_t address, const uint8_t *data, size_t length) // bulk copy used by the image loader
+    {
+        while (length > 0)
+        {
+            uint32_t offset = address & SIM_PAGE_MASK;
+            size_t chunk = min<size_t>(length, SIM_PAGE_SIZE - offset);
+            memcpy(pages.get(address >> SIM_PAGE_BITS, true)->data() + offset, data, chunk);
+            address += chunk;
+            data += chunk;
+            length -= chunk;
+        }
+    }
+
+    template <typename F>
+    void forEachPage(F visit) const // (page base address, page bytes) for every allocated page
+    {
+        pages.forEachPage([&](uint32_t pageNumber, const Page &page)
+                          { visit(pageNumber << SIM_PAGE_BITS, page); });
+    }
+
+    void clear()
+    {
+        pages.clear();
+    }
+
+private:
+    PageMap<Page> pages;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Lock-free ring for exactly one producer thread and one consumer thread.
+// Capacity is rounded up to a power of two; head and tail live on separate
+// cache lines so the two sides do not bounce a line between them.
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    bool tryPush(const T &item) // producer side, false when the ring is full
+    {
+        size_t tail = tailIndex.load(memory_order_relaxed);
+        if (tail - headCache == slots.size())
+        {
+            headCache = headIndex.load(memory_order_acquire);
+            if (tail - headCache == slots.size())
+                return false;
+        }
+        slots[tail & mask] = item;
+        tailIndex.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T &item) // consumer side, false when the ring is empty
+    {
+        size_t head = headIndex.load(memory_order_relaxed);
+        if (head == tailCache)
+        {
+            tailCache = tailIndex.load(memory_order_acquire);
+            if (head == tailCache)
+                return false;
+        }
+        item = slots[head & mask];
+        headIndex.store(head + 1, memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return headIndex.load(memory_order_acquire) == tailIndex.load(memory_order_acquire);
+    }
+
+private:
+    vector<T> slots;
+    size_t mask = 0;
+    alignas(64) atomic<size_t> headIndex{0}; // next slot to pop, written by the consumer
+    size_t tailCache = 0;                    // consumer's last view of tailIndex
+    alignas(64) atomic<size_t> tailIndex{0}; // next slot to push, written by the producer
+    size_t headCache = 0;                    // producer's last view of headIndex
+};
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <array>
+#include <bitset>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include "pipeline.h"
+#include "spsc_ring.h"
+#include "trace_delta.h"
+#include "console.h"
+
+using namespace std;
+
+// Per-cycle trace output (RFResult.txt and StateResult_*.txt, or the compact
+// <prefix>Trace.bin). The core only copies a fixed-size record into a lock-free
+// ring; a background thread does the formatting and writes through one
+// buffered handle per file.
+
+enum TraceMode : uint8_t
+{
+    TRACE_TEXT,   // legacy RFResult/StateResult text files
+    TRACE_BINARY, // delta-encoded Trace.bin, see trace_delta.h and trace_convert.cpp
+    TRACE_OFF     // no per-cycle output at all
+};
+
+bool parseTraceMode(const string &name, TraceMode &mode)
+{
+    if (name == "text")
+        mode = TRACE_TEXT;
+    else if (name == "binary")
+        mode = TRACE_BINARY;
+    else if (name == "off")
+        mode = TRACE_OFF;
+    else
+        return false;
+    return true;
+}
+
+enum TraceFormat : uint8_t
+{
+    TRACE_SINGLE_STAGE, // StateResult_SS.txt layout
+    TRACE_FIVE_STAGE    // StateResult_FS.txt layout
+};
+
+struct TraceRecord // everything the text traces print for one cycle
+{
+    stateStruct state;
+    array<uint32_t, 32> regs;
+    uint32_t cycle;
+};
+
+void formatRF(ostream &out, uint32_t cycle, const array<uint32_t, 32> &regs)
+{
+    out << "State of RF after executing cycle:\t" << cycle << "\n";
+    for (int j = 0; j < 32; j++)
+    {
+        out << bitset<32>(regs[j]) << "\n";
+    }
+}
+
+void formatStateSS(ostream &out, uint32_t cycle, const stateStruct &state)
+{
+    out << "----------------------------------------------------------------------\n";
+    out << "State after executing cycle: " << cycle << "\n";
+    out << "IF.PC: " << state.IF.PC << "\n";
+    out << "IF.nop: " << (state.IF.nop ? "True" : "False") << "\n";
+    out << "----------------------------------------------------------------------\n";
+}
+
+void formatStateFS(ostream &out, uint32_t cycle, const stateStruct &state)
+{
+    out << "----------------------------------------------------------------------\n";
+    out << "State after executing cycle: " << cycle << "\n";
+    out << "IF.nop: " << (state.IF.nop ? "True" : "False") << "\n";
+    out << "IF.PC: " << state.IF.PC << "\n";
+    out << "ID.nop: " << (state.ID.nop ? "True" : "False") << "\n";
+    out << "ID.Instr: " << bitset<32>(state.ID.Instr) << "\n";
+    out << "EX.nop: " << (state.EX.nop ? "True" : "False") << "\n";
+    out << "EX.Instr: " << bitset<32>(state.EX.Instr) << "\n";
+    out << "EX.Read_data1: " << bitset<32>(state.EX.Read_data1) << "\n";
+    out << "EX.Read_data2: " << bitset<32>(state.EX.Read_data2) << "\n";
+    out << "EX.Imm: " << bitset<32>(state.EX.Imm) << "\n";
+    out << "EX.Rs1: " << bitset<5>(state.EX.rs1) << "\n";
+    out << "EX.Rs2: " << bitset<5>(state.EX.rs2) << "\n";
+    out << "EX.Rd: " << bitset<5>(state.EX.rd) << "\n";
+    out << "EX.is_I_type: " << state.EX.is_I_type << "\n";
+    out << "EX.rd_mem: " << state.EX.rd_mem << "\n";
+    out << "EX.wrt_mem: " << state.EX.wrt_mem << "\n";
+    out << "EX.alu_op: " << (state.EX.alu_op ? "01" : "00") << "\n";
+    out << "EX.wrt_enable: " << state.EX.wrt_enable << "\n";
+    out << "MEM.nop: " << (state.MEM.nop ? "True" : "False") << "\n";
+    out << "MEM.ALUresult: " << bitset<32>(state.MEM.ALUresult) << "\n";
+    out << "MEM.Store_data: " << bitset<32>(state.MEM.Store_data) << "\n";
+    out << "MEM.Rs1: " << bitset<5>(state.MEM.rs1) << "\n";
+    out << "MEM.Rs2: " << bitset<5>(state.MEM.rs2) << "\n";
+    out << "MEM.Rd: " << bitset<5>(state.MEM.rd) << "\n";
+    out << "MEM.rd_mem: " << state.MEM.rd_mem << "\n";
+    out << "MEM.wrt_mem: " << state.MEM.wrt_mem << "\n";
+    out << "MEM.wrt_enable: " << state.MEM.wrt_enable << "\n";
+    out << "WB.nop: " << (state.WB.nop ? "True" : "False") << "\n";
+    out << "WB.Wrt_data: " << bitset<32>(state.WB.Wrt_data) << "\n";
+    out << "WB.Rs1: " << bitset<5>(state.WB.rs1) << "\n";
+    out << "WB.Rs2: " << bitset<5>(state.WB.rs2) << "\n";
+    out << "WB.rd: " << bitset<5>(state.WB.rd) << "\n";
+    out << "WB.wrt_enable: " << state.WB.wrt_enable << "\n";
+}
+
+class TraceWriter
+{
+public:
+    TraceWriter() : ring(4096) {}
+
+    ~TraceWriter()
+    {
+        close();
+    }
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    void open(const string &rfPath, const string &statePath, const string &binaryPath, TraceFormat stateFormat, TraceMode traceMode) // starts the writer thread
+    {
+        rfFile = rfPath;
+        stateFile = statePath;
+        binaryFile = binaryPath;
+        format = stateFormat;
+        mode = traceMode;
+        if (mode == TRACE_OFF)
+            return;
+        done.store(false, memory_order_relaxed);
+        worker = thread(&TraceWriter::run, this);
+    }
+
+    void push(uint32_t cycle, const array<uint32_t, 32> &regs, const stateStruct &state) // called by the core once per traced cycle
+    {
+        if (mode == TRACE_OFF)
+            return;
+        TraceRecord rec;
+        rec.cycle = cycle;
+        rec.regs = regs;
+        rec.state = state;
+        while (!ring.tryPush(rec))
+        {
+            this_thread::yield(); // ring full, wait for the writer to catch up
+        }
+    }
+
+    bool enabled() const
+    {
+        return mode != TRACE_OFF;
+    }
+
+    // Drains everything queued so far and flushes the files. Called on the core's thread,
+    // so a file the writer could not open is reported to that thread's console (the job's
+    // log in a batch run) rather than wherever the writer thread would print.
+    void close()
+    {
+        if (worker.joinable())
+        {
+            done.store(true, memory_order_release);
+            worker.join();
+            if (!openError.empty())
+                console() << openError << endl;
+            openError.clear();
+        }
+    }
+
+private:
+    void run()
+    {
+        TraceRecord rec;
+        int idle = 0;
+        while (true)
+        {
+            if (ring.tryPop(rec))
+            {
+                write(rec);
+                idle = 0;
+            }
+            else if (done.load(memory_order_acquire))
+            {
+                if (ring.empty())
+                    break;
+            }
+            else if (++idle < 64)
+            {
+                this_thread::yield();
+            }
+            else
+            {
+                this_thread::sleep_for(chrono::microseconds(100)); // core is busy elsewhere, stop spinning
+            }
+        }
+
+        if (rfOut.is_open())
+            rfOut.close();
+        if (stateOut.is_open())
+            stateOut.close();
+        if (binaryOut.is_open())
+            binaryOut.close();
+    }
+
+    void write(const TraceRecord &rec)
+    {
+        if (mode == TRACE_BINARY)
+        {
+            if (!opened)
+            {
+                binaryOut.rdbuf()->pubsetbuf(rfBuffer.data(), rfBuffer.size());
+                binaryOut.open(binaryFile, std::ios_base::trunc | std::ios_base::binary);
+                if (!binaryOut.is_open())
+                    openError = "Unable to open binary trace file.";
+                else
+                    encoder.begin(binaryOut, format);
+                opened = true;
+            }
+            if (binaryOut.is_open())
+                encoder.encode(binaryOut, rec.cycle, rec.regs, rec.state);
+            return;
+        }
+
+        if (!opened)
+        {
+            // opened on the first record so a core that never traces leaves no files behind
+            rfOut.rdbuf()->pubsetbuf(rfBuffer.data(), rfBuffer.size());
+            rfOut.open(rfFile, std::ios_base::trunc);
+            if (!rfOut.is_open())
+                openError = "Unable to open RF output file.";
+            stateOut.rdbuf()->pubsetbuf(stateBuffer.data(), stateBuffer.size());
+            stateOut.open(stateFile, std::ios_base::trunc);
+            opened = true;
+        }
+
+        if (rfOut.is_open())
+            formatRF(rfOut, rec.cycle, rec.regs);
+        if (stateOut.is_open())
+        {
+            if (format == TRACE_SINGLE_STAGE)
+                formatStateSS(stateOut, rec.cycle, rec.state);
+            else
+                formatStateFS(stateOut, rec.cycle, rec.state);
+        }
+    }
+
+    SpscRing<TraceRecord> ring;
+    thread worker;
+    atomic<bool> done{false};
+
+    // Writer thread only
+    string rfFile, stateFile, binaryFile;
+    TraceFormat format = TRACE_FIVE_STAGE;
+    TraceMode mode = TRACE_TEXT;
+    bool opened = false;
+    string openError; // reported by close() once the writer has finished
+    ofstream rfOut, stateOut, binaryOut;
+    DeltaTraceEncoder encoder;
+    vector<char> rfBuffer = vector<char>(1 << 20);
+    vector<char> stateBuffer = vector<char>(1 << 20);
+};
+
+#endif
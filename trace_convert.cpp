@@ -0,0 +1,58 @@
+// Rebuilds the legacy RFResult / StateResult text traces from a binary delta trace.
+// Usage: ./trace_convert <FS_Trace.bin> <RFResult.txt> <StateResult.txt>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <array>
+#include "trace.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if (argc != 4)
+    {
+        cout << "Usage: ./trace_convert <trace.bin> <RFResult.txt> <StateResult.txt>" << endl;
+        return -1;
+    }
+
+    ifstream in(argv[1], ios::binary);
+    if (!in.is_open())
+    {
+        cout << "Unable to open " << argv[1] << endl;
+        return -1;
+    }
+
+    DeltaTraceDecoder decoder;
+    if (!decoder.begin(in))
+    {
+        cout << argv[1] << " is not a binary delta trace." << endl;
+        return -1;
+    }
+
+    ofstream rfOut(argv[2], std::ios_base::trunc);
+    ofstream stateOut(argv[3], std::ios_base::trunc);
+    if (!rfOut.is_open() || !stateOut.is_open())
+    {
+        cout << "Unable to open output files." << endl;
+        return -1;
+    }
+
+    uint32_t cycle;
+    array<uint32_t, 32> regs;
+    stateStruct state;
+    uint64_t records = 0;
+    while (decoder.next(in, cycle, regs, state))
+    {
+        formatRF(rfOut, cycle, regs);
+        if (decoder.stateLayout() == TRACE_SINGLE_STAGE)
+            formatStateSS(stateOut, cycle, state);
+        else
+            formatStateFS(stateOut, cycle, state);
+        records++;
+    }
+
+    cout << "Converted " << records << " cycles." << endl;
+    return 0;
+}
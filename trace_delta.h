@@ -0,0 +1,303 @@
+#ifndef TRACE_DELTA_H
+#define TRACE_DELTA_H
+
+#include <iostream>
+#include <string>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include "pipeline.h"
+
+using namespace std;
+
+// Compact binary trace (<prefix>Trace.bin). Every cycle stores only the registers
+// and latch fields that changed since the previous cycle; every TRACE_KEYFRAME_INTERVAL
+// records a full keyframe is written so a reader never has to replay far.
+//
+// File layout:
+//   header   "RVDTRACE" | u8 version | u8 state layout (TraceFormat) | u32 keyframe interval (LE)
+//   record   u8 kind ('K' keyframe / 'D' delta) | varint cycle delta
+//            keyframe: 32 register varints, then STATE_FIELDS field varints
+//            delta:    varint register mask, changed register varints,
+//                      varint field mask, changed field varints
+// All varints are unsigned LEB128.
+
+#ifndef TRACE_KEYFRAME_INTERVAL
+#define TRACE_KEYFRAME_INTERVAL 1024
+#endif
+#define STATE_FIELDS 44
+
+static const char TRACE_MAGIC[8] = {'R', 'V', 'D', 'T', 'R', 'A', 'C', 'E'};
+static const uint8_t TRACE_VERSION = 3; // 2: latch PCs and WB store fields, 3: predicted next PCs
+
+// Latch fields in a fixed order so they can be diffed as a flat array
+void packState(const stateStruct &s, uint32_t *f)
+{
+    uint32_t *p = f;
+    *p++ = s.IF.PC;
+    *p++ = s.IF.nop;
+    *p++ = s.ID.PC;
+    *p++ = s.ID.Instr;
+    *p++ = s.ID.nop;
+    *p++ = s.EX.Read_data1;
+    *p++ = s.EX.Read_data2;
+    *p++ = static_cast<uint32_t>(s.EX.Imm);
+    *p++ = s.EX.Instr;
+    *p++ = s.EX.rs1;
+    *p++ = s.EX.rs2;
+    *p++ = s.EX.rd;
+    *p++ = s.EX.func3;
+    *p++ = s.EX.func7;
+    *p++ = s.EX.rd_mem;
+    *p++ = s.EX.wrt_mem;
+    *p++ = s.EX.alu_op;
+    *p++ = s.EX.wrt_enable;
+    *p++ = s.EX.nop;
+    *p++ = s.EX.is_I_type;
+    *p++ = s.MEM.ALUresult;
+    *p++ = s.MEM.Store_data;
+    *p++ = s.MEM.rs1;
+    *p++ = s.MEM.rs2;
+    *p++ = s.MEM.rd;
+    *p++ = s.MEM.rd_mem;
+    *p++ = s.MEM.wrt_mem;
+    *p++ = s.MEM.wrt_enable;
+    *p++ = s.MEM.nop;
+    *p++ = s.WB.Wrt_data;
+    *p++ = s.WB.rs1;
+    *p++ = s.WB.rs2;
+    *p++ = s.WB.rd;
+    *p++ = s.WB.wrt_enable;
+    *p++ = s.WB.nop;
+    *p++ = s.EX.PC;
+    *p++ = s.MEM.PC;
+    *p++ = s.WB.PC;
+    *p++ = s.WB.Store_addr;
+    *p++ = s.WB.Store_data;
+    *p++ = s.WB.wrt_mem;
+    *p++ = s.ID.Next_PC;
+    *p++ = s.EX.Next_PC;
+    *p++ = 0; // spare, keeps STATE_FIELDS stable if a latch field is added
+}
+
+void unpackState(const uint32_t *f, stateStruct &s)
+{
+    const uint32_t *p = f;
+    s.IF.PC = *p++;
+    s.IF.nop = *p++;
+    s.ID.PC = *p++;
+    s.ID.Instr = *p++;
+    s.ID.nop = *p++;
+    s.EX.Read_data1 = *p++;
+    s.EX.Read_data2 = *p++;
+    s.EX.Imm = static_cast<int32_t>(*p++);
+    s.EX.Instr = *p++;
+    s.EX.rs1 = *p++;
+    s.EX.rs2 = *p++;
+    s.EX.rd = *p++;
+    s.EX.func3 = *p++;
+    s.EX.func7 = *p++;
+    s.EX.rd_mem = *p++;
+    s.EX.wrt_mem = *p++;
+    s.EX.alu_op = *p++;
+    s.EX.wrt_enable = *p++;
+    s.EX.nop = *p++;
+    s.EX.is_I_type = *p++;
+    s.MEM.ALUresult = *p++;
+    s.MEM.Store_data = *p++;
+    s.MEM.rs1 = *p++;
+    s.MEM.rs2 = *p++;
+    s.MEM.rd = *p++;
+    s.MEM.rd_mem = *p++;
+    s.MEM.wrt_mem = *p++;
+    s.MEM.wrt_enable = *p++;
+    s.MEM.nop = *p++;
+    s.WB.Wrt_data = *p++;
+    s.WB.rs1 = *p++;
+    s.WB.rs2 = *p++;
+    s.WB.rd = *p++;
+    s.WB.wrt_enable = *p++;
+    s.WB.nop = *p++;
+    s.EX.PC = *p++;
+    s.MEM.PC = *p++;
+    s.WB.PC = *p++;
+    s.WB.Store_addr = *p++;
+    s.WB.Store_data = *p++;
+    s.WB.wrt_mem = *p++;
+    s.ID.Next_PC = *p++;
+    s.EX.Next_PC = *p++;
+}
+
+void writeVarint(ostream &out, uint64_t value)
+{
+    uint8_t buf[10];
+    int n = 0;
+    do
+    {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buf[n++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    out.write(reinterpret_cast<const char *>(buf), n);
+}
+
+bool readVarint(istream &in, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = in.get();
+        if (c == EOF)
+            return false;
+        value |= uint64_t(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+class DeltaTraceEncoder
+{
+public:
+    void begin(ostream &out, uint8_t layout)
+    {
+        out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        out.put(TRACE_VERSION);
+        out.put(layout);
+        uint32_t interval = TRACE_KEYFRAME_INTERVAL;
+        for (int i = 0; i < 4; i++)
+            out.put((interval >> (8 * i)) & 0xFF);
+    }
+
+    void encode(ostream &out, uint32_t cycle, const array<uint32_t, 32> &regs, const stateStruct &state)
+    {
+        uint32_t fields[STATE_FIELDS];
+        packState(state, fields);
+
+        bool keyframe = (records % TRACE_KEYFRAME_INTERVAL) == 0;
+        out.put(keyframe ? 'K' : 'D');
+        writeVarint(out, cycle - lastCycle);
+
+        if (keyframe)
+        {
+            for (int r = 0; r < 32; r++)
+                writeVarint(out, regs[r]);
+            for (int f = 0; f < STATE_FIELDS; f++)
+                writeVarint(out, fields[f]);
+        }
+        else
+        {
+            uint32_t regMask = 0;
+            for (int r = 0; r < 32; r++)
+                if (regs[r] != lastRegs[r])
+                    regMask |= 1u << r;
+            writeVarint(out, regMask);
+            for (int r = 0; r < 32; r++)
+                if (regMask & (1u << r))
+                    writeVarint(out, regs[r]);
+
+            uint64_t fieldMask = 0;
+            for (int f = 0; f < STATE_FIELDS; f++)
+                if (fields[f] != lastFields[f])
+                    fieldMask |= uint64_t(1) << f;
+            writeVarint(out, fieldMask);
+            for (int f = 0; f < STATE_FIELDS; f++)
+                if (fieldMask & (uint64_t(1) << f))
+                    writeVarint(out, fields[f]);
+        }
+
+        lastCycle = cycle;
+        lastRegs = regs;
+        memcpy(lastFields, fields, sizeof(fields));
+        records++;
+    }
+
+private:
+    uint64_t records = 0;
+    uint32_t lastCycle = 0;
+    array<uint32_t, 32> lastRegs{};
+    uint32_t lastFields[STATE_FIELDS] = {};
+};
+
+class DeltaTraceDecoder
+{
+public:
+    bool begin(istream &in) // reads the header, false if this is not a delta trace
+    {
+        char magic[sizeof(TRACE_MAGIC)];
+        if (!in.read(magic, sizeof(magic)) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+            return false;
+        int version = in.get();
+        int l = in.get();
+        uint8_t interval[4];
+        if (version != TRACE_VERSION || l == EOF || !in.read(reinterpret_cast<char *>(interval), 4))
+            return false;
+        layout = static_cast<uint8_t>(l);
+        return true;
+    }
+
+    uint8_t stateLayout() const { return layout; }
+
+    bool next(istream &in, uint32_t &cycle, array<uint32_t, 32> &regs, stateStruct &state) // false at end of trace
+    {
+        int kind = in.get();
+        if (kind != 'K' && kind != 'D')
+            return false;
+
+        uint64_t v;
+        if (!readVarint(in, v))
+            return false;
+        lastCycle += static_cast<uint32_t>(v);
+
+        if (kind == 'K')
+        {
+            for (int r = 0; r < 32; r++)
+            {
+                if (!readVarint(in, v))
+                    return false;
+                lastRegs[r] = static_cast<uint32_t>(v);
+            }
+            for (int f = 0; f < STATE_FIELDS; f++)
+            {
+                if (!readVarint(in, v))
+                    return false;
+                lastFields[f] = static_cast<uint32_t>(v);
+            }
+        }
+        else
+        {
+            uint64_t mask;
+            if (!readVarint(in, mask))
+                return false;
+            for (int r = 0; r < 32; r++)
+                if (mask & (uint64_t(1) << r))
+                {
+                    if (!readVarint(in, v))
+                        return false;
+                    lastRegs[r] = static_cast<uint32_t>(v);
+                }
+            if (!readVarint(in, mask))
+                return false;
+            for (int f = 0; f < STATE_FIELDS; f++)
+                if (mask & (uint64_t(1) << f))
+                {
+                    if (!readVarint(in, v))
+                        return false;
+                    lastFields[f] = static_cast<uint32_t>(v);
+                }
+        }
+
+        cycle = lastCycle;
+        regs = lastRegs;
+        unpackState(lastFields, state);
+        return true;
+    }
+
+private:
+    uint8_t layout = 0;
+    uint32_t lastCycle = 0;
+    array<uint32_t, 32> lastRegs{};
+    uint32_t lastFields[STATE_FIELDS] = {};
+};
+
+#endif
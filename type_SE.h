@@ -7,6 +7,8 @@
 #include <bitset>
 #include <fstream>
 #include <cstdint>
+#include <array>
+#include "events.h"
 
 
 using namespace std;
@@ -25,124 +27,497 @@ struct InstructionFields
     bitset<20> imm_J;
 };
 
-// Helper function for sign extension
-template <typename T>
-int32_t signExtend(T imm, size_t bitWidth)
+// Instruction classes as seen by the pipeline (derived from the 7-bit opcode)
+enum OpClass : uint8_t
 {
-    int32_t mask = 1 << (bitWidth - 1); // Mask to check the sign bit
-    int32_t extended = imm.to_ulong();  // Convert to unsigned long
-    if (extended & mask)
+    OPC_ILLEGAL = 0, // not an RV32IM instruction, traps when it executes
+    OPC_RTYPE,       // 0110011
+    OPC_MULDIV,      // 0110011 with funct7 0000001 (RV32M), runs on the multiply/divide units
+    OPC_ITYPE,       // 0010011
+    OPC_LOAD,        // 0000011
+    OPC_STORE,       // 0100011
+    OPC_BRANCH,      // 1100011
+    OPC_JAL,         // 1101111
+    OPC_JALR,        // 1100111
+    OPC_LUI,         // 0110111
+    OPC_AUIPC,       // 0010111
+    OPC_FENCE,       // 0001111, executes as a nop (one hart, no caches to order)
+    OPC_SYSTEM,      // 1110011, ECALL and EBREAK, both trap
+    OPC_HALT         // 1111111 (all ones word)
+};
+
+// Individual operations, one per handler of the single-stage interpreter, covering the
+// RV32I base ISA and the M extension. The R-type, M and I-type ALU ops are in funct3 order.
+enum Op : uint8_t
+{
+    OP_ILLEGAL = 0, // any encoding outside RV32IM, including an all-zero word
+    OP_ADD,
+    OP_SUB,
+    OP_SLL,
+    OP_SLT,
+    OP_SLTU,
+    OP_XOR,
+    OP_SRL,
+    OP_SRA,
+    OP_OR,
+    OP_AND,
+    OP_MUL,
+    OP_MULH,
+    OP_MULHSU,
+    OP_MULHU,
+    OP_DIV,
+    OP_DIVU,
+    OP_REM,
+    OP_REMU,
+    OP_ADDI,
+    OP_SLTI,
+    OP_SLTIU,
+    OP_XORI,
+    OP_ORI,
+    OP_ANDI,
+    OP_SLLI,
+    OP_SRLI,
+    OP_SRAI,
+    OP_LB,
+    OP_LH,
+    OP_LW,
+    OP_LBU,
+    OP_LHU,
+    OP_SB,
+    OP_SH,
+    OP_SW,
+    OP_BEQ,
+    OP_BNE,
+    OP_BLT,
+    OP_BGE,
+    OP_BLTU,
+    OP_BGEU,
+    OP_JAL,
+    OP_JALR,
+    OP_LUI,
+    OP_AUIPC,
+    OP_FENCE,
+    OP_ECALL,
+    OP_EBREAK,
+    OP_HALT, // 0xFFFFFFFF
+    OP_COUNT
+};
+
+// Instruction formats, they decide which fields and which immediate a word carries
+enum Format : uint8_t
+{
+    FMT_NONE = 0, // no operands: FENCE, ECALL, EBREAK, halt and illegal words
+    FMT_R,
+    FMT_I,
+    FMT_SHAMT,    // I-type shift, the immediate is the 5-bit shift amount
+    FMT_S,
+    FMT_B,
+    FMT_U,
+    FMT_J
+};
+
+// Why a core stopped somewhere other than at a halt. There is no trap handler to jump to,
+// the trapping instruction does not retire.
+enum TrapCause : uint8_t
+{
+    TRAP_NONE = 0,
+    TRAP_ILLEGAL_INSTRUCTION,
+    TRAP_BREAKPOINT, // EBREAK
+    TRAP_ECALL
+};
+
+// Predecoded form of one instruction. Filled once per PC and then reused, so the
+// pipeline never has to pull fields out of the raw word again.
+struct MicroOp
+{
+    uint32_t raw = 0;    // original instruction word
+    int32_t imm = 0;     // immediate for the instruction's format, already sign-extended
+    uint8_t opClass = OPC_ILLEGAL;
+    uint8_t op = OP_ILLEGAL;
+    uint8_t rd = 0;      // fields not used by the format are left at 0
+    uint8_t rs1 = 0;
+    uint8_t rs2 = 0;
+    uint8_t funct3 = 0;
+    uint8_t funct7 = 0;
+    bool valid = false;  // set once the entry has been decoded
+};
+
+// Decode table, built at compile time. It is indexed by opcode[6:2], funct3 and funct7 bits
+// 30 and 25 (SUB/ADD and SRA/SRL differ in bit 30, the M extension sets bit 25), which
+// separates every RV32IM instruction; the remaining funct7 bits and the opcode's low bits
+// are checked in predecode.
+struct DecodeEntry
+{
+    uint8_t op = OP_ILLEGAL;
+    uint8_t opClass = OPC_ILLEGAL;
+    uint8_t format = FMT_NONE;
+    bool checkFunct7 = false; // funct7 may have no bits besides 30 and 25, which the index already matched
+};
+
+constexpr uint32_t decodeIndex(uint32_t instruction)
+{
+    return ((instruction >> 2) & 0x1F) << 5 | ((instruction >> 12) & 0x7) << 2 | ((instruction >> 29) & 0x2) | ((instruction >> 25) & 0x1);
+}
+
+// Sets the entries of one opcode; funct3 < 0 matches every funct3, funct7 < 0 every value
+// of bits 30 and 25, otherwise the entry is for those two bits of funct7
+constexpr void addDecodeEntry(array<DecodeEntry, 1024> &table, uint32_t opcode, int funct3, int funct7,
+                              Op op, OpClass opClass, Format format, bool checkFunct7 = false)
+{
+    for (uint32_t f3 = 0; f3 < 8; f3++)
+        for (uint32_t bits = 0; bits < 4; bits++) // bit 30, bit 25
+            if ((funct3 < 0 || f3 == uint32_t(funct3)) && (funct7 < 0 || bits == ((uint32_t(funct7) >> 4 & 0x2) | (uint32_t(funct7) & 0x1))))
+                table[(opcode >> 2) << 5 | f3 << 2 | bits] = {op, opClass, format, checkFunct7};
+}
+
+constexpr array<DecodeEntry, 1024> buildDecodeTable()
+{
+    array<DecodeEntry, 1024> t{};
+
+    // U and J formats: funct3 and funct7 belong to the immediate
+    addDecodeEntry(t, 0x37, -1, -1, OP_LUI, OPC_LUI, FMT_U);
+    addDecodeEntry(t, 0x17, -1, -1, OP_AUIPC, OPC_AUIPC, FMT_U);
+    addDecodeEntry(t, 0x6F, -1, -1, OP_JAL, OPC_JAL, FMT_J);
+    addDecodeEntry(t, 0x67, 0, -1, OP_JALR, OPC_JALR, FMT_I);
+
+    addDecodeEntry(t, 0x63, 0, -1, OP_BEQ, OPC_BRANCH, FMT_B);
+    addDecodeEntry(t, 0x63, 1, -1, OP_BNE, OPC_BRANCH, FMT_B);
+    addDecodeEntry(t, 0x63, 4, -1, OP_BLT, OPC_BRANCH, FMT_B);
+    addDecodeEntry(t, 0x63, 5, -1, OP_BGE, OPC_BRANCH, FMT_B);
+    addDecodeEntry(t, 0x63, 6, -1, OP_BLTU, OPC_BRANCH, FMT_B);
+    addDecodeEntry(t, 0x63, 7, -1, OP_BGEU, OPC_BRANCH, FMT_B);
+
+    addDecodeEntry(t, 0x03, 0, -1, OP_LB, OPC_LOAD, FMT_I);
+    addDecodeEntry(t, 0x03, 1, -1, OP_LH, OPC_LOAD, FMT_I);
+    addDecodeEntry(t, 0x03, 2, -1, OP_LW, OPC_LOAD, FMT_I);
+    addDecodeEntry(t, 0x03, 4, -1, OP_LBU, OPC_LOAD, FMT_I);
+    addDecodeEntry(t, 0x03, 5, -1, OP_LHU, OPC_LOAD, FMT_I);
+
+    addDecodeEntry(t, 0x23, 0, -1, OP_SB, OPC_STORE, FMT_S);
+    addDecodeEntry(t, 0x23, 1, -1, OP_SH, OPC_STORE, FMT_S);
+    addDecodeEntry(t, 0x23, 2, -1, OP_SW, OPC_STORE, FMT_S);
+
+    addDecodeEntry(t, 0x13, 0, -1, OP_ADDI, OPC_ITYPE, FMT_I);
+    addDecodeEntry(t, 0x13, 1, 0x00, OP_SLLI, OPC_ITYPE, FMT_SHAMT, true);
+    addDecodeEntry(t, 0x13, 2, -1, OP_SLTI, OPC_ITYPE, FMT_I);
+    addDecodeEntry(t, 0x13, 3, -1, OP_SLTIU, OPC_ITYPE, FMT_I);
+    addDecodeEntry(t, 0x13, 4, -1, OP_XORI, OPC_ITYPE, FMT_I);
+    addDecodeEntry(t, 0x13, 5, 0x00, OP_SRLI, OPC_ITYPE, FMT_SHAMT, true);
+    addDecodeEntry(t, 0x13, 5, 0x20, OP_SRAI, OPC_ITYPE, FMT_SHAMT, true);
+    addDecodeEntry(t, 0x13, 6, -1, OP_ORI, OPC_ITYPE, FMT_I);
+    addDecodeEntry(t, 0x13, 7, -1, OP_ANDI, OPC_ITYPE, FMT_I);
+
+    addDecodeEntry(t, 0x33, 0, 0x00, OP_ADD, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 0, 0x20, OP_SUB, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 1, 0x00, OP_SLL, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 2, 0x00, OP_SLT, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 3, 0x00, OP_SLTU, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 4, 0x00, OP_XOR, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 5, 0x00, OP_SRL, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 5, 0x20, OP_SRA, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 6, 0x00, OP_OR, OPC_RTYPE, FMT_R, true);
+    addDecodeEntry(t, 0x33, 7, 0x00, OP_AND, OPC_RTYPE, FMT_R, true);
+
+    addDecodeEntry(t, 0x33, 0, 0x01, OP_MUL, OPC_MULDIV, FMT_R, true);
+    addDecodeEntry(t, 0x33, 1, 0x01, OP_MULH, OPC_MULDIV, FMT_R, true);
+    addDecodeEntry(t, 0x33, 2, 0x01, OP_MULHSU, OPC_MULDIV, FMT_R, true);
+    addDecodeEntry(t, 0x33, 3, 0x01, OP_MULHU, OPC_MULDIV, FMT_R, true);
+    addDecodeEntry(t, 0x33, 4, 0x01, OP_DIV, OPC_MULDIV, FMT_R, true);
+    addDecodeEntry(t, 0x33, 5, 0x01, OP_DIVU, OPC_MULDIV, FMT_R, true);
+    addDecodeEntry(t, 0x33, 6, 0x01, OP_REM, OPC_MULDIV, FMT_R, true);
+    addDecodeEntry(t, 0x33, 7, 0x01, OP_REMU, OPC_MULDIV, FMT_R, true);
+
+    addDecodeEntry(t, 0x0F, 0, -1, OP_FENCE, OPC_FENCE, FMT_NONE);
+    addDecodeEntry(t, 0x73, 0, -1, OP_ECALL, OPC_SYSTEM, FMT_NONE); // told apart from EBREAK by the whole word
+
+    return t;
+}
+
+constexpr array<DecodeEntry, 1024> DECODE_TABLE = buildDecodeTable();
+
+// Decodes one instruction word into a MicroOp, used to fill the decode cache. Anything
+// outside RV32IM comes back as OP_ILLEGAL; the all-ones word is the simulator's halt.
+constexpr MicroOp predecode(uint32_t instruction)
+{
+    MicroOp uop{};
+    uop.raw = instruction;
+    uop.valid = true;
+
+    if (instruction == 0xFFFFFFFF)
     {
-        // If sign bit is 1, extend with 1s
-        extended |= ~((1 << bitWidth) - 1);
+        uop.opClass = OPC_HALT;
+        uop.op = OP_HALT;
+        return uop;
     }
-    return extended;
+
+    const DecodeEntry &entry = DECODE_TABLE[decodeIndex(instruction)];
+    uint32_t funct7 = instruction >> 25;
+    if ((instruction & 0x3) != 0x3 || entry.op == OP_ILLEGAL || (entry.checkFunct7 && (funct7 & ~0x21u) != 0))
+        return uop;
+    if (entry.opClass == OPC_SYSTEM && instruction != 0x00000073 && instruction != 0x00100073)
+        return uop; // the rest of SYSTEM is Zicsr
+
+    uop.opClass = entry.opClass;
+    uop.op = instruction == 0x00100073 ? OP_EBREAK : entry.op;
+
+    uint8_t rd = (instruction >> 7) & 0x1F;
+    uint8_t funct3 = (instruction >> 12) & 0x7;
+    uint8_t rs1 = (instruction >> 15) & 0x1F;
+    uint8_t rs2 = (instruction >> 20) & 0x1F;
+
+    switch (entry.format)
+    {
+    case FMT_R:
+        uop.rd = rd;
+        uop.rs1 = rs1;
+        uop.rs2 = rs2;
+        uop.funct3 = funct3;
+        uop.funct7 = funct7;
+        break;
+    case FMT_I:
+        uop.rd = rd;
+        uop.rs1 = rs1;
+        uop.funct3 = funct3;
+        uop.imm = static_cast<int32_t>(instruction) >> 20;
+        break;
+    case FMT_SHAMT:
+        uop.rd = rd;
+        uop.rs1 = rs1;
+        uop.funct3 = funct3;
+        uop.funct7 = funct7;
+        uop.imm = rs2; // shamt sits where rs2 would be
+        break;
+    case FMT_S:
+        uop.rs1 = rs1;
+        uop.rs2 = rs2;
+        uop.funct3 = funct3;
+        uop.imm = ((static_cast<int32_t>(instruction) >> 25) << 5) | rd; // imm[11:5] | imm[4:0]
+        break;
+    case FMT_B:
+        uop.rs1 = rs1;
+        uop.rs2 = rs2;
+        uop.funct3 = funct3;
+        uop.imm = ((static_cast<int32_t>(instruction) >> 31) * 4096) | // imm[12]
+                  (((instruction >> 7) & 0x1) << 11) |                  // imm[11]
+                  (((instruction >> 25) & 0x3F) << 5) |                 // imm[10:5]
+                  (((instruction >> 8) & 0xF) << 1);                    // imm[4:1]
+        break;
+    case FMT_U:
+        uop.rd = rd;
+        uop.imm = static_cast<int32_t>(instruction & 0xFFFFF000);
+        break;
+    case FMT_J:
+        uop.rd = rd;
+        uop.imm = ((static_cast<int32_t>(instruction) >> 31) * 1048576) | // imm[20]
+                  (((instruction >> 12) & 0xFF) << 12) |                   // imm[19:12]
+                  (((instruction >> 20) & 0x1) << 11) |                    // imm[11]
+                  (((instruction >> 21) & 0x3FF) << 1);                    // imm[10:1]
+        break;
+    default:
+        break;
+    }
+    return uop;
 }
 
-InstructionFields checkInstr(bitset<32> instruction)
+static_assert(predecode(0x00000013).op == OP_ADDI, "canonical nop");
+static_assert(predecode(0x40A5D593).op == OP_SRAI && predecode(0x40A5D593).imm == 10, "srai a1, a1, 10");
+static_assert(predecode(0x0205D593).op == OP_ILLEGAL, "RV32 shift amounts are 5 bits");
+static_assert(predecode(0x40B50533).op == OP_SUB, "sub a0, a0, a1");
+static_assert(predecode(0x40B54533).op == OP_ILLEGAL, "XOR has no funct7 variant");
+static_assert(predecode(0x02B50533).op == OP_MUL && predecode(0x02B57533).op == OP_REMU, "mul/remu a0, a0, a1");
+static_assert(predecode(0x42B50533).op == OP_ILLEGAL, "funct7 0100001");
+static_assert(predecode(0xFE000EE3).imm == -4, "beq x0, x0, -4");
+static_assert(predecode(0x00000000).op == OP_ILLEGAL, "an all-zero word is not an instruction");
+static_assert(predecode(0x00100073).op == OP_EBREAK && predecode(0x00000073).op == OP_ECALL, "SYSTEM");
+
+Format formatOf(const MicroOp &uop)
 {
+    if (uop.opClass == OPC_ILLEGAL || uop.opClass == OPC_HALT)
+        return FMT_NONE;
+    return static_cast<Format>(DECODE_TABLE[decodeIndex(uop.raw)].format);
+}
 
+// Field dump of one instruction word, as the decode table splits it up
+InstructionFields checkInstr(bitset<32> instruction)
+{
     InstructionFields fields;
+    uint32_t word = instruction.to_ulong();
+    MicroOp uop = predecode(word);
 
-    bitset<7> opcode = bitset<7>((instruction.to_ulong()) & 0x7F);
+    fields.rd = uop.rd;
+    fields.funct3 = uop.funct3;
+    fields.rs1 = uop.rs1;
+    fields.rs2 = uop.rs2;
+    fields.funct7 = uop.funct7;
 
-    // I-Type - works
-    if (opcode == bitset<7>("0000011") || opcode == bitset<7>("0010011"))
+    char letter;
+    switch (formatOf(uop))
     {
-        fields.rd = bitset<5>((instruction.to_ulong() >> 7) & 0x1F);
-        fields.funct3 = bitset<3>((instruction.to_ulong() >> 12) & 0x7);
-        fields.rs1 = bitset<5>((instruction.to_ulong() >> 15) & 0x1F);
-        fields.imm_I = bitset<12>((instruction.to_ullong() >> 20) & 0xFFF);
-
-        cout << "Pre-SignExtended: " << fields.imm_I << endl;
-        fields.imm_I = signExtend(bitset<12>((instruction.to_ullong() >> 20) & 0xFFF), 12);
-
-        cout << "I-Type detected" << endl;
-        cout << "opcode: " << opcode << endl;
-        cout << "rd : " << fields.rd << endl;
-        cout << "funct3 : " << fields.funct3 << endl;
-        cout << "rs1 : " << fields.rs1 << endl;
-        cout << "imm_I (sign-extended): " << fields.imm_I << endl;
-
-    // R-Type - works
+    case FMT_R:
+        letter = 'R';
+        break;
+    case FMT_I:
+    case FMT_SHAMT:
+        fields.imm_I = uop.imm;
+        letter = 'I';
+        break;
+    case FMT_S:
+        fields.imm_S = uop.imm;
+        letter = 'S';
+        break;
+    case FMT_B:
+        fields.imm_B = uop.imm; // imm[11:0], bit 0 is always 0
+        letter = 'B';
+        break;
+    case FMT_U:
+        fields.imm_U = word >> 12;
+        letter = 'U';
+        break;
+    case FMT_J:
+        fields.imm_J = uop.imm >> 1; // imm[20:1]
+        letter = 'J';
+        break;
+    default:
+        return fields;
     }
-    else if (opcode == bitset<7>("0110011"))
+
+    SIM_EVENT(LOG_DECODE, LOG_DEBUG, EV_DECODE, word, letter);
+    return fields;
+}
+
+// Semantics shared by every core
+
+uint32_t aluResult(uint8_t op, uint32_t a, uint32_t b) // R-type, M and I-type ALU ops, b is rs2 or the immediate
+{
+    switch (op)
     {
-        fields.rd = bitset<5>((instruction.to_ulong() >> 7) & 0x1F);
-        fields.funct3 = bitset<3>((instruction.to_ulong() >> 12) & 0x7);
-        fields.rs1 = bitset<5>((instruction.to_ulong() >> 15) & 0x1F);
-        fields.rs2 = bitset<5>((instruction.to_ulong() >> 20) & 0x1F);
-        fields.funct7 = bitset<7>((instruction.to_ulong() >> 25) & 0x7F);
-
-        cout << "R-Type detected" << endl;
-        cout << "rd : " << fields.rd << endl;
-        cout << "funct3 : " << fields.funct3 << endl;
-        cout << "rs1 : " << fields.rs1 << endl;
-        cout << "rs2 : " << fields.rs2 << endl;
-        cout << "funct7 : " << fields.funct7 << endl;
-
-    // S-Type - works
+    case OP_ADD:
+    case OP_ADDI:
+        return a + b;
+    case OP_SUB:
+        return a - b;
+    case OP_SLL:
+    case OP_SLLI:
+        return a << (b & 0x1F);
+    case OP_SLT:
+    case OP_SLTI:
+        return static_cast<int32_t>(a) < static_cast<int32_t>(b);
+    case OP_SLTU:
+    case OP_SLTIU:
+        return a < b;
+    case OP_XOR:
+    case OP_XORI:
+        return a ^ b;
+    case OP_SRL:
+    case OP_SRLI:
+        return a >> (b & 0x1F);
+    case OP_SRA:
+    case OP_SRAI:
+        return static_cast<uint32_t>(static_cast<int32_t>(a) >> (b & 0x1F));
+    case OP_OR:
+    case OP_ORI:
+        return a | b;
+    case OP_AND:
+    case OP_ANDI:
+        return a & b;
+    case OP_MUL:
+        return a * b;
+    case OP_MULH:
+        return static_cast<uint32_t>((int64_t(int32_t(a)) * int64_t(int32_t(b))) >> 32);
+    case OP_MULHSU:
+        return static_cast<uint32_t>((int64_t(int32_t(a)) * int64_t(uint64_t(b))) >> 32);
+    case OP_MULHU:
+        return static_cast<uint32_t>((uint64_t(a) * uint64_t(b)) >> 32);
+    case OP_DIV: // division by zero gives all ones, the one overflowing case gives the dividend
+        if (b == 0)
+            return 0xFFFFFFFF;
+        if (a == 0x80000000 && b == 0xFFFFFFFF)
+            return a;
+        return static_cast<uint32_t>(int32_t(a) / int32_t(b));
+    case OP_DIVU:
+        return b == 0 ? 0xFFFFFFFF : a / b;
+    case OP_REM: // remainder by zero gives the dividend, the overflowing case 0
+        if (b == 0)
+            return a;
+        if (a == 0x80000000 && b == 0xFFFFFFFF)
+            return 0;
+        return static_cast<uint32_t>(int32_t(a) % int32_t(b));
+    case OP_REMU:
+        return b == 0 ? a : a % b;
+    default:
+        return 0;
     }
-    else if (opcode == bitset<7>("0100011"))
+}
+
+bool branchTaken(uint8_t op, uint32_t a, uint32_t b)
+{
+    switch (op)
     {
-        fields.imm_S = signExtend(
-            bitset<12>(
-                ((instruction.to_ulong() >> 7) & 0x1F) |       // Bits 4:0
-                ((instruction.to_ulong() >> 25) & 0x7F) << 5), // Bits 11:5
-            12);
-        fields.funct3 = bitset<3>((instruction.to_ulong() >> 12) & 0x7);
-        fields.rs1 = bitset<5>((instruction.to_ulong() >> 15) & 0x1F);
-        fields.rs2 = bitset<5>((instruction.to_ulong() >> 20) & 0x1F);
-
-        cout << "S-Type detected" << endl;
-        cout << "funct3 : " << fields.funct3 << endl;
-        cout << "rs1 : " << fields.rs1 << endl;
-        cout << "rs2 : " << fields.rs2 << endl;
-        cout << "imm_S (sign-extended): " << fields.imm_S << endl;
-
-    // B-Type - works
+    case OP_BEQ:
+        return a == b;
+    case OP_BNE:
+        return a != b;
+    case OP_BLT:
+        return static_cast<int32_t>(a) < static_cast<int32_t>(b);
+    case OP_BGE:
+        return static_cast<int32_t>(a) >= static_cast<int32_t>(b);
+    case OP_BLTU:
+        return a < b;
+    case OP_BGEU:
+        return a >= b;
+    default:
+        return false;
     }
-    else if (opcode == bitset<7>("1100011"))
+}
+
+int accessBytes(uint8_t op) // size of a load or store
+{
+    switch (op)
     {
-        fields.imm_B = signExtend(
-            bitset<13>(
-                ((instruction.to_ulong() >> 31) & 0x1) << 12 | // imm[12]
-                ((instruction.to_ulong() >> 7) & 0x1) << 11 |  // imm[11]
-                ((instruction.to_ulong() >> 25) & 0x3F) << 5 | // imm[10:5]
-                ((instruction.to_ulong() >> 8) & 0xF) << 1),   // imm[4:1]
-            13);
-        fields.funct3 = bitset<3>((instruction.to_ulong() >> 12) & 0x7);
-        fields.rs1 = bitset<5>((instruction.to_ulong() >> 15) & 0x1F);
-        fields.rs2 = bitset<5>((instruction.to_ulong() >> 20) & 0x1F);
-
-        cout << "B-Type detected" << endl;
-        cout << "imm_B (sign-extended): " << fields.imm_B << endl;
-        cout << "funct3: " << fields.funct3 << endl;
-        cout << "rs1: " << fields.rs1 << endl;
-        cout << "rs2: " << fields.rs2 << endl;
+    case OP_LB:
+    case OP_LBU:
+    case OP_SB:
+        return 1;
+    case OP_LH:
+    case OP_LHU:
+    case OP_SH:
+        return 2;
+    default:
+        return 4;
     }
+}
 
-    // J-type
-    else if (opcode == bitset<7>("1101111"))
+uint32_t loadResult(uint8_t op, uint32_t data) // memory returns the bytes zero-extended, LB/LH sign-extend them
+{
+    if (op == OP_LB)
+        return static_cast<uint32_t>(static_cast<int32_t>(data << 24) >> 24);
+    if (op == OP_LH)
+        return static_cast<uint32_t>(static_cast<int32_t>(data << 16) >> 16);
+    return data;
+}
+
+TrapCause trapCauseOf(uint8_t op)
+{
+    if (op == OP_ECALL)
+        return TRAP_ECALL;
+    if (op == OP_EBREAK)
+        return TRAP_BREAKPOINT;
+    return TRAP_ILLEGAL_INSTRUCTION;
+}
+
+const char *trapName(uint8_t cause)
+{
+    switch (cause)
     {
-        fields.rd = bitset<5>((instruction.to_ulong() >> 7) & 0x1F);
-
-        // Combine the parts directly into a 20-bit immediate in the correct order
-        fields.imm_J = signExtend(
-            bitset<20>(
-                ((instruction.to_ulong() >> 31) & 0x1) << 19 |  // imm[20]
-                ((instruction.to_ulong() >> 21) & 0x3FF) << 9 | // imm[10:1]
-                ((instruction.to_ulong() >> 20) & 0x1) << 8 |   // imm[11]
-                ((instruction.to_ulong() >> 12) & 0xFF)),       // imm[19:12]
-            20);
-
-        cout << "J-Type detected" << endl;
-        cout << "opcode: " << opcode << endl;
-        cout << "rd: " << fields.rd << endl;
-        cout << "imm_J (sign-extended): " << fields.imm_J << endl;
+    case TRAP_ILLEGAL_INSTRUCTION:
+        return "Illegal instruction";
+    case TRAP_BREAKPOINT:
+        return "Breakpoint";
+    case TRAP_ECALL:
+        return "Environment call";
+    default:
+        return "No trap";
     }
-
-    return fields;
 }
 
 #endif